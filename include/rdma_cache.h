@@ -0,0 +1,78 @@
+// rdma_cache.h
+#ifndef RDMA_CACHE_H
+#define RDMA_CACHE_H
+
+#include "rdma_common.h"
+
+#define CACHE_MAX_PEERS 16
+#define CACHE_EPOCH_AREA 4096  // Epoch words, one per peer, ahead of the slots
+
+typedef struct {
+    int peer;              // -1: free slot
+    uint64_t remote_off;
+    uint32_t len;
+    uint64_t epoch;        // Peer epoch sampled before the fill
+    int next;              // Hash chain, or free list while the slot is free
+    int lru_prev;          // LRU list, most recently used first
+    int lru_next;
+} cache_entry_t;
+
+// Cache of remote ranges in local registered memory, keyed by
+// (peer, remote offset, length), with LRU replacement. Each peer owns an
+// epoch word in our memory and bumps it (RDMA Write or atomic) whenever
+// its data changes; entries filled under an older epoch are refetched.
+// Peers are connections whose MR covers the local buffer (the context
+// passed to cache_init, or connections sharing its MR).
+typedef struct {
+    rdma_context_t *local;
+    uint64_t epoch_off;    // Offset of the epoch words in the local buffer
+    uint64_t slot_off;     // Offset of the first slot
+    uint32_t slot_size;
+    uint32_t num_slots;
+    
+    rdma_context_t *peers[CACHE_MAX_PEERS];
+    int num_peers;
+    
+    cache_entry_t *entries;  // One per slot
+    int *buckets;            // Hash heads, num_slots of them
+    int free_head;           // Unused slots, -1 once all are filled
+    int lru_head, lru_tail;  // Filled slots; the tail is the next victim
+    
+    // Stats
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t stale;
+    uint64_t evictions;
+    uint64_t bytes_fetched;
+    uint64_t bytes_saved;
+} rdma_cache_t;
+
+// Use [local_off, local_off + size) of the local buffer: epoch words, then
+// slots of slot_size bytes
+int cache_init(rdma_cache_t *c, rdma_context_t *local, uint64_t local_off,
+               size_t size, uint32_t slot_size);
+// Returns the peer index; its epoch word starts at 0
+int cache_add_peer(rdma_cache_t *c, rdma_context_t *peer);
+// Offset of a peer's epoch word in the local buffer, to publish to it
+uint64_t cache_epoch_offset(rdma_cache_t *c, int peer);
+// Pointer to the range in local memory, fetched with an RDMA Read on a miss
+// or stale entry. Valid until the next cache_read(); NULL on error.
+const void *cache_read(rdma_cache_t *c, int peer, uint64_t remote_off, uint32_t len);
+void cache_invalidate(rdma_cache_t *c, int peer);
+void cache_print_stats(rdma_cache_t *c);
+void cache_destroy(rdma_cache_t *c);
+
+// Owner side: bumps the epoch words peers published, by atomic
+// fetch-and-add. The old value an atomic returns lands in a scratch word
+// registered on its own, so nothing in the served buffer is overwritten.
+typedef struct {
+    rdma_context_t *ctx;
+    uint64_t *scratch;
+    struct ibv_mr *mr;
+} cache_owner_t;
+
+int cache_owner_init(cache_owner_t *o, rdma_context_t *ctx);
+int cache_bump_epoch(cache_owner_t *o, uint64_t epoch_off);
+void cache_owner_destroy(cache_owner_t *o);
+
+#endif // RDMA_CACHE_H
@@ -12,12 +12,26 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <sys/mman.h>
+#include <time.h>
 #include <netdb.h>
 #include <infiniband/verbs.h>
 #include "hlthunk.h"
 
 #define MSG_SIZE 1024
 #define RDMA_BUFFER_SIZE (4 * 1024 * 1024)  // 4MB default
+#define RDMA_MAX_WR 128                      // Send/receive queue depth
+#define RDMA_CQ_SIZE (2 * RDMA_MAX_WR)
+#define RDMA_QP_TIMEOUT 14    // 4.096us * 2^14 = ~67ms local ACK timeout
+#define RDMA_QP_RETRY_CNT 7
+
+// On-Demand-Paging modes for the host-memory registration path
+enum rdma_odp_mode {
+    RDMA_ODP_OFF = 0,   // Pin and register the whole buffer up front
+    RDMA_ODP_AUTO,      // Explicit ODP if the device supports it, else pinned
+    RDMA_ODP_EXPLICIT,  // ODP MR covering just the buffer range
+    RDMA_ODP_IMPLICIT   // Local-only ODP MR over the whole address space, plus
+                        // a buffer-sized ODP MR for remote access
+};
 
 // Connection information exchanged between client and server
 struct cm_con_data_t {
@@ -26,6 +40,31 @@ struct cm_con_data_t {
     uint32_t qp_num;    // Queue pair number
     uint16_t lid;       // Local ID
     uint8_t gid[16];    // Global ID
+    uint8_t max_rd_atomic;       // RDMA Reads we can initiate (max_qp_init_rd_atom)
+    uint8_t max_dest_rd_atomic;  // RDMA Reads we can serve (max_qp_rd_atom)
+    uint8_t mtu;                 // Port active_mtu (enum ibv_mtu)
+    uint8_t gid_index;           // Source GID index in use
+    uint8_t gid_type;            // enum ibv_gid_type of that entry (IB on InfiniBand)
+    uint8_t traffic_class;       // Requested traffic class (DSCP << 2)
+    uint8_t timeout;             // Local ACK timeout exponent
+    uint8_t retry_cnt;
+} __attribute__((packed));
+
+// Control channel message on the TCP socket
+enum ctrl_msg_type {
+    CTRL_RECOVER = 1,  // QP failed, value = bytes acknowledged so far
+    CTRL_DONE,         // Transfer finished, value = total bytes
+    CTRL_EPOCH,        // value = offset of an epoch word in the sender's buffer
+    CTRL_FILE,         // File stream starts, value = file size
+    CTRL_CHUNK,        // value = chunk size << 32 | number of slots
+    CTRL_CREDIT,       // value = receive slot that is free again
+    CTRL_CHECKSUM      // Checksummed write of value bytes; reply value 1 if the peer verifies
+};
+
+struct ctrl_msg_t {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t value;
 } __attribute__((packed));
 
 // RDMA resources
@@ -36,6 +75,7 @@ typedef struct {
     uint64_t gaudi_handle;
     uint64_t device_va;
     struct hlthunk_hw_ip_info hw_info;
+    char gaudi_bus_id[16];  // PCI bus ID, e.g. "0000:19:00.0"; empty for any
     
     // IB resources
     struct ibv_context *ib_ctx;
@@ -44,27 +84,82 @@ typedef struct {
     struct ibv_cq *cq;
     struct ibv_qp *qp;
     struct ibv_port_attr port_attr;
+    struct ibv_device_attr dev_attr;
+    uint8_t ib_port;  // Port to use, 0 selects port 1
+    char ib_dev_name[64];
     
     // Connection info
     struct cm_con_data_t remote_props;
     int sock;
+    int no_qp;  // Shared base context (connection pool): no QP of its own
+    uint8_t max_rd_atomic;       // Negotiated outstanding RDMA Reads as initiator
+    uint8_t max_dest_rd_atomic;  // Negotiated outstanding RDMA Reads as responder
+    
+    // Path parameters; the requested values are replaced by the negotiated
+    // ones during the handshake
+    enum ibv_mtu path_mtu;
+    uint8_t gid_index;
+    int gid_index_set;  // gid_index was given explicitly, don't search
+    int gid_is_rocev2;
+    uint8_t traffic_class;
+    uint8_t qp_timeout;
+    uint8_t qp_retry_cnt;
     
     // Buffer info
     size_t buffer_size;
     void *buffer;  // For CPU access if available
     uint64_t host_device_va;  // Host buffer mapped to Gaudi
+    int buffer_mmapped;  // Host buffer came from anonymous mmap (lazy pages)
+    int mw_bind;         // Register the MR so memory windows can be bound to it
+    
+    // ODP info
+    int odp_mode;    // Requested mode (enum rdma_odp_mode)
+    int odp_active;  // Mode actually registered, RDMA_ODP_OFF if pinned
+    struct ibv_mr *remote_mr;  // Buffer-sized MR the peer gets when ctx->mr is local-only
+    uint32_t odp_rc_caps;  // rc_odp_caps reported by the device
+    double mr_reg_ms;      // Time spent in memory registration
+    uint64_t odp_prefetch_count;
+    uint64_t odp_prefetch_bytes;
 } rdma_context_t;
 
 // Function declarations
 int init_gaudi_dmabuf(rdma_context_t *ctx, size_t size);
+int init_host_buffer(rdma_context_t *ctx, size_t size);
 int init_rdma_resources(rdma_context_t *ctx, const char *ib_dev_name);
+int open_rdma_device(rdma_context_t *ctx, const char *ib_dev_name);
+int register_rdma_memory(rdma_context_t *ctx);
+int create_qp(rdma_context_t *ctx);
+int sock_listen(int port);
+int sock_connect(const char *server_name, int port);
 int connect_qp(rdma_context_t *ctx, const char *server_name, int port);
+int reconnect_qp(rdma_context_t *ctx);
+int send_ctrl(rdma_context_t *ctx, uint32_t type, uint64_t value);
+int recv_ctrl(rdma_context_t *ctx, uint32_t *type, uint64_t *value);
 int post_send(rdma_context_t *ctx, int opcode);
 int post_receive(rdma_context_t *ctx);
+int post_rdma_range(rdma_context_t *ctx, int opcode, uint64_t local_off,
+                    uint64_t remote_off, uint32_t len, uint64_t wr_id);
+int post_rdma_to(rdma_context_t *ctx, int opcode, uint64_t local_off,
+                 uint64_t remote_addr, uint32_t rkey, uint32_t len, uint64_t wr_id);
+int post_atomic(rdma_context_t *ctx, int opcode, uint64_t local_off, uint64_t remote_addr,
+                uint32_t rkey, uint64_t compare_add, uint64_t swap, uint64_t wr_id);
+int post_write_imm(rdma_context_t *ctx, uint64_t local_off, uint64_t remote_off,
+                   uint32_t len, uint32_t imm, uint64_t wr_id);
+int post_imm_receive(rdma_context_t *ctx);
 int poll_completion(rdma_context_t *ctx);
+uint64_t buffer_addr(rdma_context_t *ctx);
+size_t mtu_bytes(enum ibv_mtu mtu);
+void query_local_gid(rdma_context_t *ctx, union ibv_gid *gid);
+void cleanup_ib_resources(rdma_context_t *ctx);
 void cleanup_resources(rdma_context_t *ctx);
 void simulate_hpu_operation(rdma_context_t *ctx, const char *operation);
 
+// ODP functions
+int parse_odp_mode(const char *str);
+const char *odp_mode_str(int mode);
+int odp_prefetch(rdma_context_t *ctx, void *addr, size_t len, int for_write);
+void print_odp_stats(rdma_context_t *ctx);
+
 // Helper functions
 static inline uint64_t htonll(uint64_t val) {
     return htobe64(val);
@@ -74,4 +169,10 @@ static inline uint64_t ntohll(uint64_t val) {
     return be64toh(val);
 }
 
+static inline double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
 #endif // RDMA_DMABUF_COMMON_H
\ No newline at end of file
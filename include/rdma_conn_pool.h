@@ -0,0 +1,60 @@
+// rdma_conn_pool.h
+#ifndef RDMA_CONN_POOL_H
+#define RDMA_CONN_POOL_H
+
+#include "rdma_common.h"
+
+#define POOL_MAX_PEERS 65536
+#define POOL_CONNECT_TIMEOUT_MS 10000
+
+// Where to reach a peer's pool listener
+typedef struct {
+    char host[64];
+    int port;
+} pool_peer_t;
+
+// A live connection: shares ib_ctx/PD/MR/CQ with the pool's base context,
+// owns only its QP and the TCP socket used for the handshake
+typedef struct {
+    rdma_context_t ctx;
+    int peer_id;
+    uint64_t last_used;
+} pool_conn_t;
+
+// Lazy connection manager. QPs are created on first use of a peer, the
+// least recently used one is evicted when qp_budget is reached, and a peer
+// that evicted us is reconnected transparently on the next use.
+typedef struct {
+    rdma_context_t *base;  // Owns device, PD, MR and CQ
+    int my_id;
+    int listen_fd;
+    int qp_budget;
+    int num_peers;
+    pool_peer_t *peers;
+    pool_conn_t **conns;   // By peer id, NULL while not connected
+    int active;
+    int pending_peer;      // Outgoing connect in progress, -1 if none
+    uint64_t tick;
+    
+    // Stats
+    uint64_t connects;
+    uint64_t accepts;
+    uint64_t evictions;
+    int peak_active;
+} conn_pool_t;
+
+// peer_list is "host:port,host:port,..."; entry i is peer id i and the
+// entry for my_id gives the port we listen on
+int conn_pool_init(conn_pool_t *pool, rdma_context_t *base, int my_id,
+                   const char *peer_list, int qp_budget);
+// Connected context for a peer, connecting (and evicting) if needed
+rdma_context_t *conn_pool_get(conn_pool_t *pool, int peer_id);
+// Serve incoming connection requests and drop peers that went away
+int conn_pool_progress(conn_pool_t *pool);
+// RDMA Write to a peer, reconnecting once if the connection turned out stale
+int conn_pool_write(conn_pool_t *pool, int peer_id, uint64_t local_off,
+                    uint64_t remote_off, uint32_t len);
+void conn_pool_print(conn_pool_t *pool);
+void conn_pool_destroy(conn_pool_t *pool);
+
+#endif // RDMA_CONN_POOL_H
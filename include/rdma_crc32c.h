@@ -0,0 +1,23 @@
+// rdma_crc32c.h
+#ifndef RDMA_CRC32C_H
+#define RDMA_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC32C (Castagnoli), as used by iSCSI and NVMe-oF. crc is the CRC of the
+// data before buf (0 to start), so a range can be checksummed in pieces.
+// The implementation is picked on first use from what the CPU supports:
+// AVX-512 VPCLMULQDQ folding, SSE4.2 crc32 over three interleaved streams,
+// or slicing-by-8 tables.
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+// Name of the implementation crc32c() dispatches to
+const char *crc32c_impl(void);
+
+// Individual implementations, for benchmarking; NULL when the CPU lacks
+// the instructions. Index 0 is the portable one.
+#define CRC32C_NUM_IMPLS 3
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const void *buf, size_t len);
+crc32c_fn crc32c_get_impl(int i, const char **name);
+
+#endif // RDMA_CRC32C_H
@@ -0,0 +1,30 @@
+// rdma_filestream.h
+#ifndef RDMA_FILESTREAM_H
+#define RDMA_FILESTREAM_H
+
+#include "rdma_common.h"
+
+#define FSTREAM_CHUNK_SIZE (1024 * 1024)
+#define FSTREAM_MAX_SLOTS 16
+#define FSTREAM_ALIGN 4096  // O_DIRECT alignment of offsets, lengths and buffers
+
+// File-to-remote streaming. The registered buffer is split into slots; the
+// sender reads file chunks into them with io_uring and RDMA-writes each one
+// (with the chunk index as immediate) as soon as it lands, and the receiver
+// writes arriving chunks to disk with io_uring and hands the slot back with
+// a credit on the TCP socket. Disk reads, the wire and disk writes overlap.
+// Both sides need a CPU-visible buffer (init_host_buffer()).
+typedef struct {
+    size_t chunk;       // 0 selects FSTREAM_CHUNK_SIZE (sender decides)
+    int slots;
+    int direct;         // File opened with O_DIRECT
+    uint64_t size;
+    uint64_t chunks;
+    double elapsed_ms;
+} fstream_t;
+
+int fstream_send(rdma_context_t *ctx, const char *path, fstream_t *fs);
+int fstream_recv(rdma_context_t *ctx, const char *path, fstream_t *fs);
+void print_fstream_stats(const char *label, const fstream_t *fs);
+
+#endif // RDMA_FILESTREAM_H
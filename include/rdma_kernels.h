@@ -0,0 +1,32 @@
+// rdma_kernels.h
+#ifndef RDMA_KERNELS_H
+#define RDMA_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define KERN_MAX_THREADS 16
+#define KERN_MT_MIN_BYTES (4 * 1024 * 1024)  // Smaller buffers stay on the caller's thread
+
+typedef enum {
+    KERN_INT32,  // Wrapping arithmetic; alpha is truncated to an integer
+    KERN_FP32,
+    KERN_BF16    // Computed in fp32, rounded to nearest even on store
+} kern_dtype_t;
+
+// Elementwise kernels over count elements for processing received buffers
+// on the host. The instruction set (AVX-512, AVX2 or scalar) is picked on
+// first use; buffers of KERN_MT_MIN_BYTES and more are split across a pool
+// of persistent worker threads. Every path uses a separate multiply and
+// add, so results don't depend on which one runs.
+void kern_sum(void *dst, const void *src, size_t count, kern_dtype_t type);     // dst += src
+void kern_scale(void *buf, size_t count, kern_dtype_t type, float alpha);       // buf *= alpha
+void kern_axpy(void *y, const void *x, size_t count, kern_dtype_t type, float alpha);  // y += alpha * x
+
+// Name of the instruction set in use
+const char *kern_isa(void);
+// Threads for large buffers (default: online CPUs, at most KERN_MAX_THREADS)
+void kern_set_threads(int threads);
+size_t kern_type_size(kern_dtype_t type);
+
+#endif // RDMA_KERNELS_H
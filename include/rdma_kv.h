@@ -0,0 +1,84 @@
+// rdma_kv.h
+#ifndef RDMA_KV_H
+#define RDMA_KV_H
+
+#include "rdma_common.h"
+
+// Store layout inside the registered region, starting at KV_BASE_OFF:
+//   index: KV_ENTRIES entries of struct kv_entry_t (linear probing)
+//   slabs: one KV_SLAB_SIZE value slab per index entry
+// Fields are in the server's byte order, which atomics require anyway.
+#define KV_BASE_OFF (64 * 1024)
+#define KV_BUCKETS 1024
+#define KV_PROBE 8                            // Entries fetched per lookup
+#define KV_ENTRIES (KV_BUCKETS + KV_PROBE - 1)  // Probe windows never wrap
+#define KV_SLAB_SIZE 2048
+#define KV_INDEX_SIZE (((size_t)KV_ENTRIES * sizeof(struct kv_entry_t) + 4095) & ~(size_t)4095)
+#define KV_REGION_SIZE (KV_INDEX_SIZE + (size_t)KV_ENTRIES * KV_SLAB_SIZE)
+#define KV_MAX_VALUE (KV_SLAB_SIZE - sizeof(struct kv_slab_hdr_t))
+#define KV_HINTS 1024
+#define KV_RETRIES 64
+
+#define KV_MISS -1
+#define KV_ERROR -2
+
+// lock_ver is even when stable and odd while a writer holds the entry
+struct kv_entry_t {
+    uint64_t lock_ver;
+    uint64_t key;      // 0: empty
+    uint32_t len;
+    uint32_t reserved;
+    uint64_t pad;
+} __attribute__((packed));
+
+// A slab is a header followed by the value. PUTs overwrite slabs in place,
+// so a READ racing one can return old and new bytes mixed; crc covers the
+// rest of the header and the value, and readers reject any slab whose
+// CRC32C doesn't match (a torn read passes only on a 2^-32 collision).
+struct kv_slab_hdr_t {
+    uint64_t version;
+    uint64_t key;
+    uint32_t len;
+    uint32_t crc;      // crc32c of version, key, len, then the value
+} __attribute__((packed));
+
+// Client view of a peer's store. GETs and PUTs are one-sided: the server
+// CPU is not involved after kv_format()/kv_put_local().
+typedef struct {
+    rdma_context_t *ctx;
+    uint64_t remote_base;
+    uint32_t rkey;
+    
+    // Scratch offsets in the local registered buffer
+    uint64_t win_off;    // Probe window
+    uint64_t cas_off;    // Atomic result
+    uint64_t slab_off;   // Slab read target
+    uint64_t put_off;    // Slab staged for a PUT
+    uint64_t ent_off;    // Entry staged for a PUT
+    
+    // Where each key was last seen, so a GET can skip the index
+    struct { uint64_t key; uint32_t entry; uint32_t len; } hint[KV_HINTS];
+    
+    // Stats
+    uint64_t gets;
+    uint64_t one_read_gets;
+    uint64_t misses;
+    uint64_t puts;
+    uint64_t reads;
+    uint64_t retries;
+    uint64_t cas_failures;
+} kv_client_t;
+
+// Server: empty the store (needs a CPU-visible buffer)
+int kv_format(rdma_context_t *ctx);
+// Server: insert or update locally before clients start
+int kv_put_local(rdma_context_t *ctx, uint64_t key, const void *val, uint32_t len);
+
+// Client: the peer's store at remote_props.addr + KV_BASE_OFF
+int kv_client_init(kv_client_t *kv, rdma_context_t *ctx);
+// Returns the value length, KV_MISS or KV_ERROR
+int kv_get(kv_client_t *kv, uint64_t key, void *val, uint32_t max);
+int kv_put(kv_client_t *kv, uint64_t key, const void *val, uint32_t len);
+void kv_print_stats(kv_client_t *kv);
+
+#endif // RDMA_KV_H
@@ -0,0 +1,33 @@
+// rdma_multirail.h
+#ifndef RDMA_MULTIRAIL_H
+#define RDMA_MULTIRAIL_H
+
+#include "rdma_common.h"
+
+#define RDMA_MAX_RAILS 16
+#define RAIL_CHUNK_SIZE (256 * 1024)  // Bytes per posted WR on a rail
+#define RAIL_WINDOW 32                // Outstanding WRs per rail (< RDMA_MAX_WR)
+
+// A rail is one HCA port with its own PD/MR/CQ/QP over the shared buffer.
+// Rails borrow the buffer of the primary context; they never own it.
+typedef struct {
+    rdma_context_t rails[RDMA_MAX_RAILS];
+    int num_rails;
+    uint32_t weight[RDMA_MAX_RAILS];  // Link rate in Mb/s from ibv_port_attr
+    uint64_t bytes[RDMA_MAX_RAILS];   // Bytes moved by each rail
+} multirail_t;
+
+// spec is "all" (every active port of every HCA) or "dev[:port],dev[:port],..."
+int multirail_init(multirail_t *mr, rdma_context_t *primary, const char *spec);
+// Agree on the rail count over the primary socket, then connect each rail
+// on its own TCP port (port + 1 + rail index)
+int multirail_connect(multirail_t *mr, rdma_context_t *primary,
+                      const char *server_name, int port);
+// Stripe [offset, offset + len) across the rails, weighted by link rate
+int multirail_transfer(multirail_t *mr, int opcode, uint64_t offset, size_t len);
+void multirail_print(multirail_t *mr);
+void multirail_cleanup(multirail_t *mr);
+
+uint32_t port_rate_mbps(const struct ibv_port_attr *attr);
+
+#endif // RDMA_MULTIRAIL_H
@@ -0,0 +1,41 @@
+// rdma_mw.h
+#ifndef RDMA_MW_H
+#define RDMA_MW_H
+
+#include "rdma_common.h"
+
+// Access granted to a peer through a window, on the wire (network byte order)
+struct mw_grant_t {
+    uint64_t addr;
+    uint64_t len;
+    uint32_t rkey;
+    uint32_t access;  // IBV_ACCESS_REMOTE_* flags
+} __attribute__((packed));
+
+// A type-2 memory window over part of the registered buffer. Binding and
+// invalidation are work requests on the QP's send queue, so narrowing or
+// revoking remote access never re-registers memory. The MR must have been
+// registered with ctx->mw_bind set.
+typedef struct {
+    struct ibv_mw *mw;
+    uint32_t rkey;     // Changes on every bind, so stale grants stop working
+    uint64_t addr;
+    uint64_t len;
+    int access;
+    int bound;
+} rdma_window_t;
+
+int mw_supported(rdma_context_t *ctx);
+int mw_alloc(rdma_context_t *ctx, rdma_window_t *w);
+// Bind the window over [offset, offset + len) of the buffer, invalidating
+// any previous binding first
+int mw_bind(rdma_context_t *ctx, rdma_window_t *w, uint64_t offset,
+            uint64_t len, int access);
+// Revoke the peer's access; later accesses with the old rkey fail
+int mw_invalidate(rdma_context_t *ctx, rdma_window_t *w);
+// Send the current binding to the peer over the control socket
+int mw_publish(rdma_context_t *ctx, rdma_window_t *w);
+int mw_recv_grant(rdma_context_t *ctx, struct mw_grant_t *grant);
+void mw_free(rdma_window_t *w);
+
+#endif // RDMA_MW_H
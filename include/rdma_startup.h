@@ -0,0 +1,28 @@
+// rdma_startup.h
+#ifndef RDMA_STARTUP_H
+#define RDMA_STARTUP_H
+
+#include "rdma_common.h"
+
+// Startup parameters and per-phase timings (ms)
+typedef struct {
+    const char *ib_dev_name;  // NULL: NIC paired with the accelerator, else first
+    const char *server_name;  // NULL on the server
+    int port;
+    size_t buffer_size;
+    
+    double t_device;     // Accelerator open, HBM alloc, DMA-buf export
+    double t_ib_open;    // IB device open, PD, CQ, QP
+    double t_register;   // MR registration
+    double t_socket;     // TCP connect/accept
+    double t_handshake;  // QP info exchange and INIT->RTR->RTS
+    double t_total;      // Wall clock for the whole startup
+} rdma_startup_t;
+
+// Bring up the context with independent phases overlapped:
+//   accelerator setup || IB open/PD/CQ/QP || TCP connect/accept
+//   then MR registration (still overlapping the TCP accept), then handshake
+int parallel_startup(rdma_context_t *ctx, rdma_startup_t *st);
+void print_startup_timing(const rdma_startup_t *st);
+
+#endif // RDMA_STARTUP_H
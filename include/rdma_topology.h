@@ -0,0 +1,43 @@
+// rdma_topology.h
+#ifndef RDMA_TOPOLOGY_H
+#define RDMA_TOPOLOGY_H
+
+#include "rdma_common.h"
+#include "rdma_multirail.h"
+
+#define RDMA_MAX_ACCELS 16
+#define HABANA_PCI_VENDOR 0x1da3
+
+// TCP port accelerator pair i handshakes on, past the rails' ports
+#define ACCEL_PORT(port, i) ((port) + 1 + RDMA_MAX_RAILS + (i))
+
+// Bus IDs of the Habana accelerators present, from sysfs
+int topo_list_accelerators(char bus_ids[][16], int max);
+// "all" or a comma separated list of PCI bus IDs; -1 if a listed ID is not
+// a Habana device
+int parse_accel_list(const char *spec, char bus_ids[][16], int max);
+// Pick the IB device closest to a PCI device: shared PCIe switch first,
+// then same NUMA node. A NIC on another socket is only picked, with a
+// warning, if there is none on the device's own. Returns -1 if no IB
+// device could be ranked.
+int topo_pick_nic(const char *bus_id, char *ib_dev, size_t len);
+
+// Open one accelerator by bus ID with its own DMA-buf region and register
+// it on its paired NIC (or ib_dev_override)
+int open_accelerator(rdma_context_t *ctx, const char *bus_id, size_t size,
+                     const char *ib_dev_override);
+// Open n accelerators into ctxs[]; returns how many were opened (all or fail)
+int open_accelerators(rdma_context_t *ctxs, char bus_ids[][16], int n,
+                      size_t size, int odp_mode);
+// Agree on the smaller accelerator count over the primary socket (closing
+// the rest) and connect pair i on ACCEL_PORT(port, i); server_name is NULL
+// on the server
+int accel_connect(rdma_context_t *ctxs, int *n, rdma_context_t *primary,
+                  const char *server_name, int port);
+// Bulk-write each accelerator's buffer to its peer (or serve the peer's
+// writes) on all pairs at once; bytes is the total acknowledged
+int accel_transfer(rdma_context_t *ctxs, int n, int serve, uint64_t *bytes);
+void close_accelerators(rdma_context_t *ctxs, int n);
+void print_accelerators(rdma_context_t *ctxs, int n);
+
+#endif // RDMA_TOPOLOGY_H
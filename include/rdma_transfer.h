@@ -0,0 +1,55 @@
+// rdma_transfer.h
+#ifndef RDMA_TRANSFER_H
+#define RDMA_TRANSFER_H
+
+#include "rdma_common.h"
+#include "rdma_crc32c.h"
+
+#define XFER_CHUNK_SIZE (64 * 1024)
+#define XFER_READ_CHUNK_SIZE (256 * 1024)
+#define XFER_WINDOW 32         // Outstanding chunks (< RDMA_MAX_WR)
+#define XFER_MAX_RECOVERIES 8
+
+// A chunked one-sided transfer that survives QP errors. Progress is tracked
+// as the in-order prefix of acknowledged bytes, so after a recovery the
+// transfer resumes from the last acknowledged chunk.
+typedef struct {
+    uint64_t local_off;
+    uint64_t remote_off;
+    size_t len;
+    size_t chunk;          // 0 selects XFER_CHUNK_SIZE
+    int checksum;          // Writes: CRC32C per chunk, verified by the peer
+    
+    uint64_t acked;        // Bytes completed successfully
+    int recoveries;
+    double recovery_ms;    // Total time spent recovering
+    double elapsed_ms;
+    
+    uint64_t crc_chunks;   // Chunks checksummed (sender) or verified (receiver)
+    uint64_t crc_errors;   // Chunks that failed verification
+    double crc_ms;         // CPU time spent on checksums
+    
+    // Receiver: run on the data as it arrives, each chunk once it has landed
+    // and been verified; without per-chunk completions (no checksums), on
+    // the acknowledged bytes after the transfer. Never on a failed one.
+    void (*process)(void *data, size_t len, void *arg);
+    void *process_arg;
+    double process_ms;
+} rdma_xfer_t;
+
+// Active side: RDMA Write the range, recovering the QP on errors. With
+// checksum set, each chunk goes out as a Write with immediate carrying its
+// CRC32C and the peer verifies it as it lands, while later chunks are still
+// on the wire; both buffers must be CPU-visible, otherwise plain writes are
+// used. crc_errors then holds the peer's count of bad chunks.
+int xfer_write(rdma_context_t *ctx, rdma_xfer_t *x);
+// Active side: pull the range with RDMA Reads, keeping as many in flight as
+// the negotiated initiator depth allows (plus as many queued behind them)
+int xfer_read(rdma_context_t *ctx, rdma_xfer_t *x);
+// Passive side: take part in recoveries until the peer reports completion,
+// verifying chunk checksums if the peer asks for it (x->local_off must then
+// match the peer's remote_off) and running x->process if set
+int xfer_serve(rdma_context_t *ctx, rdma_xfer_t *x);
+void print_xfer_stats(const char *label, const rdma_xfer_t *x);
+
+#endif // RDMA_TRANSFER_H
@@ -0,0 +1,90 @@
+// rdma_ud.h
+#ifndef RDMA_UD_H
+#define RDMA_UD_H
+
+#include "rdma_common.h"
+
+#define UD_MSG_SIZE 192        // Payload per datagram; with the header it fits a 256 B MTU
+#define UD_GRH_SIZE 40         // Every UD receive starts with a GRH
+#define UD_RECV_DEPTH 64
+#define UD_SEND_DEPTH 64
+#define UD_WINDOW 16           // Unacknowledged messages per peer
+#define UD_INBOX 64            // Delivered messages not yet consumed
+#define UD_MAX_PEERS 64
+#define UD_RTO_MS 20           // Retransmit timeout
+#define UD_MAX_RETRIES 50
+#define UD_QKEY 0x11111111
+
+enum ud_msg_type {
+    UD_DATA = 1,
+    UD_ACK
+};
+
+// On-the-wire header, network byte order
+struct ud_hdr_t {
+    uint32_t seq;    // DATA: sequence number; ACK: every seq below this arrived
+    uint16_t src;    // Sender's index in the receiver's peer table
+    uint8_t type;
+    uint8_t len;
+} __attribute__((packed));
+
+typedef struct {
+    struct ibv_ah *ah;
+    uint32_t qpn;
+    uint16_t remote_idx;  // Our index in the peer's table
+    
+    uint32_t next_seq;    // Next sequence number to send
+    uint32_t acked;       // Everything below this was acknowledged
+    uint32_t expected;    // Next sequence number to deliver
+    int retries;          // Consecutive timeouts without progress
+    double sent_ms;       // Last (re)transmission of the oldest unacked message
+    int ack_pending;      // Data arrived since our last ack
+    int failed;
+} ud_peer_t;
+
+typedef struct {
+    int peer;
+    uint8_t len;
+    char data[UD_MSG_SIZE];
+} ud_inbox_t;
+
+// One UD QP serving every peer, with go-back-N reliability (sequence numbers,
+// cumulative acks, retransmit timer) for small control and metadata messages
+typedef struct {
+    rdma_context_t *ctx;   // Provides device, PD, port and path settings
+    struct ibv_cq *cq;
+    struct ibv_qp *qp;
+    struct ibv_mr *mr;
+    char *buf;             // Receive slots, then per-peer send windows and ack slots
+    int send_outstanding;
+    
+    ud_peer_t peers[UD_MAX_PEERS];
+    int num_peers;
+    
+    ud_inbox_t inbox[UD_INBOX];
+    int inbox_head;
+    int inbox_count;
+    
+    // Stats
+    uint64_t sent;
+    uint64_t received;
+    uint64_t retransmits;
+    uint64_t duplicates;
+} ud_endpoint_t;
+
+int ud_init(ud_endpoint_t *ud, rdma_context_t *ctx);
+// Swap UD addresses (QPN, LID, GID) over a connected TCP socket and create
+// the address handle. Returns the peer index.
+int ud_connect(ud_endpoint_t *ud, int sock);
+// Queue a message; blocks while the peer's window is full
+int ud_send(ud_endpoint_t *ud, int peer, const void *data, size_t len);
+// Next in-order message from any peer; returns its length, -1 on timeout
+int ud_recv(ud_endpoint_t *ud, int *peer, void *data, size_t max, int timeout_ms);
+// Wait until everything sent to peer was acknowledged
+int ud_flush(ud_endpoint_t *ud, int peer, int timeout_ms);
+// Handle completions and retransmit timers
+int ud_progress(ud_endpoint_t *ud);
+void ud_print_stats(ud_endpoint_t *ud);
+void ud_destroy(ud_endpoint_t *ud);
+
+#endif // RDMA_UD_H
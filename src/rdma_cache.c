@@ -0,0 +1,237 @@
+#include "rdma_cache.h"
+
+static uint32_t cache_hash(rdma_cache_t *c, int peer, uint64_t remote_off, uint32_t len) {
+    uint64_t h = remote_off * 0x9e3779b97f4a7c15ULL;
+    h ^= ((uint64_t)peer << 32 | len) * 0xbf58476d1ce4e5b9ULL;
+    return (h ^ (h >> 29)) % c->num_slots;
+}
+
+// The owner updates it with RDMA, behind the compiler's back
+static uint64_t read_epoch(rdma_cache_t *c, int peer) {
+    volatile uint64_t *epoch = (volatile uint64_t *)
+        ((char *)c->local->buffer + cache_epoch_offset(c, peer));
+    return *epoch;
+}
+
+static void *slot_ptr(rdma_cache_t *c, int slot) {
+    return (char *)c->local->buffer + c->slot_off + (uint64_t)slot * c->slot_size;
+}
+
+static void lru_remove(rdma_cache_t *c, int slot) {
+    cache_entry_t *e = &c->entries[slot];
+    
+    if (e->lru_prev >= 0) c->entries[e->lru_prev].lru_next = e->lru_next;
+    else c->lru_head = e->lru_next;
+    if (e->lru_next >= 0) c->entries[e->lru_next].lru_prev = e->lru_prev;
+    else c->lru_tail = e->lru_prev;
+}
+
+static void lru_push(rdma_cache_t *c, int slot) {
+    cache_entry_t *e = &c->entries[slot];
+    
+    e->lru_prev = -1;
+    e->lru_next = c->lru_head;
+    if (c->lru_head >= 0) c->entries[c->lru_head].lru_prev = slot;
+    else c->lru_tail = slot;
+    c->lru_head = slot;
+}
+
+static void lru_touch(rdma_cache_t *c, int slot) {
+    if (c->lru_head == slot) return;
+    lru_remove(c, slot);
+    lru_push(c, slot);
+}
+
+// Drop a filled slot from its hash chain and the LRU list and free it
+static void unlink_entry(rdma_cache_t *c, int slot) {
+    cache_entry_t *e = &c->entries[slot];
+    int *link = &c->buckets[cache_hash(c, e->peer, e->remote_off, e->len)];
+    
+    while (*link != slot) link = &c->entries[*link].next;
+    *link = e->next;
+    lru_remove(c, slot);
+    
+    e->peer = -1;
+    e->next = c->free_head;
+    c->free_head = slot;
+}
+
+// A free slot if there is one, else the least recently used; O(1) either way
+static int pick_victim(rdma_cache_t *c) {
+    int slot;
+    
+    if (c->free_head < 0) {
+        unlink_entry(c, c->lru_tail);
+        c->evictions++;
+    }
+    slot = c->free_head;
+    c->free_head = c->entries[slot].next;
+    return slot;
+}
+
+int cache_init(rdma_cache_t *c, rdma_context_t *local, uint64_t local_off,
+               size_t size, uint32_t slot_size) {
+    memset(c, 0, sizeof(*c));
+    
+    if (!local->buffer || local_off + size > local->buffer_size ||
+        size <= CACHE_EPOCH_AREA + slot_size) {
+        fprintf(stderr, "Cache needs a CPU-visible local region larger than one slot\n");
+        return -1;
+    }
+    
+    c->local = local;
+    c->epoch_off = local_off;
+    c->slot_off = local_off + CACHE_EPOCH_AREA;
+    c->slot_size = slot_size;
+    c->num_slots = (size - CACHE_EPOCH_AREA) / slot_size;
+    
+    c->entries = calloc(c->num_slots, sizeof(*c->entries));
+    c->buckets = malloc(c->num_slots * sizeof(*c->buckets));
+    if (!c->entries || !c->buckets) {
+        cache_destroy(c);
+        return -1;
+    }
+    for (uint32_t i = 0; i < c->num_slots; i++) {
+        c->entries[i].peer = -1;
+        c->entries[i].next = i + 1 < c->num_slots ? (int)i + 1 : -1;
+        c->buckets[i] = -1;
+    }
+    c->free_head = 0;
+    c->lru_head = c->lru_tail = -1;
+    
+    memset((char *)local->buffer + c->epoch_off, 0, CACHE_EPOCH_AREA);
+    return 0;
+}
+
+int cache_add_peer(rdma_cache_t *c, rdma_context_t *peer) {
+    if (c->num_peers >= CACHE_MAX_PEERS) {
+        fprintf(stderr, "Too many cache peers\n");
+        return -1;
+    }
+    c->peers[c->num_peers] = peer;
+    return c->num_peers++;
+}
+
+uint64_t cache_epoch_offset(rdma_cache_t *c, int peer) {
+    return c->epoch_off + (uint64_t)peer * sizeof(uint64_t);
+}
+
+const void *cache_read(rdma_cache_t *c, int peer, uint64_t remote_off, uint32_t len) {
+    uint32_t h;
+    int slot;
+    
+    if (peer < 0 || peer >= c->num_peers || len > c->slot_size) return NULL;
+    
+    c->lookups++;
+    h = cache_hash(c, peer, remote_off, len);
+    for (slot = c->buckets[h]; slot >= 0; slot = c->entries[slot].next) {
+        cache_entry_t *e = &c->entries[slot];
+        if (e->peer == peer && e->remote_off == remote_off && e->len == len) break;
+    }
+    
+    // Sample the epoch before any fetch: a bump that races with the Read
+    // leaves the entry marked stale rather than hiding the change
+    uint64_t epoch = read_epoch(c, peer);
+    
+    if (slot >= 0 && c->entries[slot].epoch == epoch) {
+        lru_touch(c, slot);
+        c->hits++;
+        c->bytes_saved += len;
+        return slot_ptr(c, slot);
+    }
+    
+    if (slot >= 0) {
+        c->stale++;
+        lru_touch(c, slot);
+    } else {
+        slot = pick_victim(c);
+        c->entries[slot] = (cache_entry_t) {
+            .peer = peer,
+            .remote_off = remote_off,
+            .len = len,
+            .next = c->buckets[h]
+        };
+        c->buckets[h] = slot;
+        lru_push(c, slot);
+    }
+    
+    rdma_context_t *conn = c->peers[peer];
+    uint64_t local_off = c->slot_off + (uint64_t)slot * c->slot_size;
+    if (post_rdma_to(conn, IBV_WR_RDMA_READ, local_off, conn->remote_props.addr + remote_off,
+                     conn->remote_props.rkey, len, 0) || poll_completion(conn) < 0) {
+        fprintf(stderr, "Cache fill failed\n");
+        unlink_entry(c, slot);
+        return NULL;
+    }
+    
+    c->entries[slot].epoch = epoch;
+    c->bytes_fetched += len;
+    return slot_ptr(c, slot);
+}
+
+void cache_invalidate(rdma_cache_t *c, int peer) {
+    for (uint32_t i = 0; i < c->num_slots; i++) {
+        if (c->entries[i].peer == peer) unlink_entry(c, i);
+    }
+}
+
+void cache_print_stats(rdma_cache_t *c) {
+    printf("   - Cache: %lu lookups, %.1f%% hits, %lu stale, %lu evictions (%u slots of %u bytes)\n",
+           c->lookups, c->lookups ? 100.0 * c->hits / c->lookups : 0.0,
+           c->stale, c->evictions, c->num_slots, c->slot_size);
+    printf("   - Cache: %lu bytes fetched, %lu bytes saved\n",
+           c->bytes_fetched, c->bytes_saved);
+}
+
+void cache_destroy(rdma_cache_t *c) {
+    free(c->entries);
+    free(c->buckets);
+    memset(c, 0, sizeof(*c));
+}
+
+int cache_owner_init(cache_owner_t *o, rdma_context_t *ctx) {
+    memset(o, 0, sizeof(*o));
+    o->ctx = ctx;
+    
+    o->scratch = aligned_alloc(sizeof(uint64_t), sizeof(uint64_t));
+    if (!o->scratch) return -1;
+    o->mr = ibv_reg_mr(ctx->pd, o->scratch, sizeof(uint64_t), IBV_ACCESS_LOCAL_WRITE);
+    if (!o->mr) {
+        fprintf(stderr, "Failed to register epoch scratch word\n");
+        cache_owner_destroy(o);
+        return -1;
+    }
+    return 0;
+}
+
+int cache_bump_epoch(cache_owner_t *o, uint64_t epoch_off) {
+    rdma_context_t *ctx = o->ctx;
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)o->scratch,
+        .length = sizeof(uint64_t),
+        .lkey = o->mr->lkey
+    };
+    struct ibv_send_wr wr = {
+        .sg_list = &sge,
+        .num_sge = 1,
+        .opcode = IBV_WR_ATOMIC_FETCH_AND_ADD,
+        .send_flags = IBV_SEND_SIGNALED,
+        .wr.atomic = {
+            .remote_addr = ctx->remote_props.addr + epoch_off,
+            .rkey = ctx->remote_props.rkey,
+            .compare_add = 1
+        }
+    }, *bad_wr;
+    
+    if (ibv_post_send(ctx->qp, &wr, &bad_wr) || poll_completion(ctx) < 0) {
+        fprintf(stderr, "Failed to bump peer epoch\n");
+        return -1;
+    }
+    return 0;
+}
+
+void cache_owner_destroy(cache_owner_t *o) {
+    if (o->mr) ibv_dereg_mr(o->mr);
+    free(o->scratch);
+    memset(o, 0, sizeof(*o));
+}
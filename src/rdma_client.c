@@ -1,4 +1,12 @@
 #include "rdma_common.h"
+#include "rdma_multirail.h"
+#include "rdma_topology.h"
+#include "rdma_startup.h"
+#include "rdma_transfer.h"
+#include "rdma_ud.h"
+#include "rdma_mw.h"
+#include "rdma_kv.h"
+#include "rdma_cache.h"
 
 int main(int argc, char *argv[]) {
     rdma_context_t ctx = {0};
@@ -9,7 +17,19 @@ int main(int argc, char *argv[]) {
     char *server_name = NULL;
     int port = 20000;
     char *ib_dev_name = NULL;
+    char *rail_spec = NULL;
     size_t buffer_size = RDMA_BUFFER_SIZE;
+    multirail_t rails = {0};
+    char *accel_spec = NULL;
+    char bus_ids[RDMA_MAX_ACCELS][16];
+    rdma_context_t accels[RDMA_MAX_ACCELS - 1];  // Accelerators beyond the primary
+    int num_accels = 0, num_extra = 0;
+    ud_endpoint_t ud = {0};
+    int use_ud = 0, ud_peer = -1;
+    int use_mw = 0;
+    int use_kv = 0;
+    int use_cache = 0;
+    int use_crc = 0;
     
     // Parse arguments
     for (int i = 1; i < argc; i++) {
@@ -19,8 +39,33 @@ int main(int argc, char *argv[]) {
             ib_dev_name = argv[++i];
         } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
             buffer_size = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            ctx.traffic_class = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+            ctx.gid_index = atoi(argv[++i]);
+            ctx.gid_index_set = 1;
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            accel_spec = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            rail_spec = argv[++i];
+        } else if (strcmp(argv[i], "-u") == 0) {
+            use_ud = 1;
+        } else if (strcmp(argv[i], "-c") == 0) {
+            use_cache = 1;
+        } else if (strcmp(argv[i], "-z") == 0) {
+            use_crc = 1;
+        } else if (strcmp(argv[i], "-k") == 0) {
+            use_kv = 1;
+        } else if (strcmp(argv[i], "-w") == 0) {
+            use_mw = 1;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            ctx.odp_mode = parse_odp_mode(argv[++i]);
+            if (ctx.odp_mode < 0) {
+                fprintf(stderr, "Error: ODP mode must be off, auto, explicit or implicit\n");
+                return 1;
+            }
         } else if (strcmp(argv[i], "-h") == 0) {
-            printf("Usage: %s <server> [-p port] [-d ib_dev] [-s buffer_size]\n", argv[0]);
+            printf("Usage: %s <server> [-p port] [-d ib_dev] [-s buffer_size] [-o odp_mode] [-r rails] [-g accels] [-t tclass] [-x gid_index] [-u] [-w] [-k] [-c] [-z]\n", argv[0]);
             return 0;
         } else if (!server_name) {
             server_name = argv[i];
@@ -29,7 +74,7 @@ int main(int argc, char *argv[]) {
     
     if (!server_name) {
         fprintf(stderr, "Error: Server name required\n");
-        printf("Usage: %s <server> [-p port] [-d ib_dev] [-s buffer_size]\n", argv[0]);
+        printf("Usage: %s <server> [-p port] [-d ib_dev] [-s buffer_size] [-o odp_mode] [-r rails] [-g accels] [-t tclass] [-x gid_index] [-u] [-w] [-k] [-c] [-z]\n", argv[0]);
         return 1;
     }
     
@@ -38,12 +83,41 @@ int main(int argc, char *argv[]) {
     printf("Server: %s:%d\n", server_name, port);
     printf("Buffer size: %zu bytes\n", buffer_size);
     if (ib_dev_name) printf("IB device: %s\n", ib_dev_name);
+    if (ctx.odp_mode) printf("ODP mode: %s\n", odp_mode_str(ctx.odp_mode));
+    if (rail_spec) printf("Rails: %s\n", rail_spec);
+    if (accel_spec) printf("Accelerators: %s\n", accel_spec);
+    if (use_ud) printf("UD control messages: on\n");
+    if (use_mw) printf("Memory windows: on\n");
+    if (use_kv) printf("KV store: on\n");
+    if (use_cache) printf("Read cache: on\n");
+    if (use_crc) printf("Bulk write checksums: CRC32C (%s)\n", crc32c_impl());
     printf("\n");
     
-    // Initialize Gaudi DMA-buf
-    printf("Initializing Gaudi DMA-buf...\n");
-    if (init_gaudi_dmabuf(&ctx, buffer_size) < 0) {
-        fprintf(stderr, "Failed to initialize Gaudi DMA-buf\n");
+    if (accel_spec) {
+        num_accels = parse_accel_list(accel_spec, bus_ids, RDMA_MAX_ACCELS);
+        if (num_accels < 0) {
+            fprintf(stderr, "Invalid accelerator list: %s\n", accel_spec);
+            return 1;
+        }
+        if (num_accels == 0) {
+            printf("No accelerators found, using a host-memory stand-in\n");
+            num_accels = 0;
+        } else {
+            snprintf(ctx.gaudi_bus_id, sizeof(ctx.gaudi_bus_id), "%s", bus_ids[0]);
+        }
+    }
+    
+    // Bring up the accelerator, RDMA resources and the server connection
+    // with independent phases overlapped
+    printf("Starting up, connecting to server %s:%d...\n", server_name, port);
+    rdma_startup_t startup = {
+        .ib_dev_name = ib_dev_name,
+        .server_name = server_name,
+        .port = port,
+        .buffer_size = buffer_size
+    };
+    if (parallel_startup(&ctx, &startup) < 0) {
+        fprintf(stderr, "Failed to connect to server\n");
         cleanup_resources(&ctx);
         return 1;
     }
@@ -53,24 +127,71 @@ int main(int argc, char *argv[]) {
     } else {
         printf("✓ Using regular memory buffer\n");
     }
+    printf("✓ RDMA resources initialized on %s\n", ctx.ib_dev_name);
+    printf("✓ Connected to server\n");
+    print_startup_timing(&startup);
     
-    // Initialize RDMA resources
-    printf("\nInitializing RDMA resources...\n");
-    if (init_rdma_resources(&ctx, ib_dev_name) < 0) {
-        fprintf(stderr, "Failed to initialize RDMA resources\n");
-        cleanup_resources(&ctx);
-        return 1;
+    // With windows the server publishes no MR rkey; everything below goes
+    // through the window it grants over its whole buffer
+    if (use_mw) {
+        struct mw_grant_t grant;
+        
+        if (mw_recv_grant(&ctx, &grant) < 0 || grant.len == 0) {
+            fprintf(stderr, "Server did not grant buffer access\n");
+            cleanup_resources(&ctx);
+            return 1;
+        }
+        ctx.remote_props.addr = grant.addr;
+        ctx.remote_props.rkey = grant.rkey;
+        printf("✓ Server buffer accessible through window rkey 0x%x\n", grant.rkey);
     }
-    printf("✓ RDMA resources initialized\n");
     
-    // Connect to server
-    printf("\nConnecting to server %s:%d...\n", server_name, port);
-    if (connect_qp(&ctx, server_name, port) < 0) {
-        fprintf(stderr, "Failed to connect to server\n");
-        cleanup_resources(&ctx);
-        return 1;
+    // Each further accelerator gets its own DMA-buf on its own paired NIC
+    if (num_accels > 1) {
+        printf("\nOpening %d more accelerator(s)...\n", num_accels - 1);
+        num_extra = open_accelerators(accels, bus_ids + 1, num_accels - 1,
+                                      buffer_size, ctx.odp_mode);
+        if (num_extra < 0) {
+            fprintf(stderr, "Failed to open accelerators\n");
+            cleanup_resources(&ctx);
+            return 1;
+        }
+        if (accel_connect(accels, &num_extra, &ctx, server_name, port) < 0) {
+            fprintf(stderr, "Failed to connect accelerators\n");
+            close_accelerators(accels, num_extra);
+            cleanup_resources(&ctx);
+            return 1;
+        }
+        printf("✓ %d accelerator(s) ready, %d pair(s) connected\n", num_extra + 1, num_extra);
+    }
+    
+    // Bring up the additional rails
+    if (rail_spec) {
+        printf("\nSetting up rails...\n");
+        if (multirail_init(&rails, &ctx, rail_spec) < 0 ||
+            multirail_connect(&rails, &ctx, server_name, port) < 0) {
+            fprintf(stderr, "Failed to set up rails\n");
+            multirail_cleanup(&rails);
+            close_accelerators(accels, num_extra);
+            cleanup_resources(&ctx);
+            return 1;
+        }
+        printf("✓ %d rail(s) ready\n", rails.num_rails);
+    }
+    
+    // One UD QP for small control messages, addressed like the RC peer
+    if (use_ud) {
+        printf("\nSetting up UD endpoint...\n");
+        if (ud_init(&ud, &ctx) < 0 || (ud_peer = ud_connect(&ud, ctx.sock)) < 0) {
+            fprintf(stderr, "Failed to set up UD endpoint\n");
+            ud_destroy(&ud);
+            multirail_cleanup(&rails);
+            close_accelerators(accels, num_extra);
+            cleanup_resources(&ctx);
+            return 1;
+        }
+        printf("✓ UD endpoint ready\n");
     }
-    printf("✓ Connected to server\n");
     
     // Function to display buffer data (first few integers)
     void display_buffer_data(const char *label, void *buffer, size_t size) {
@@ -194,9 +315,214 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    // Striped RDMA Write across all rails
+    if (rails.num_rails) {
+        printf("\n--- Multi-rail RDMA Write Test ---\n");
+        printf("Striping %zu bytes across %d rail(s)...\n", ctx.buffer_size, rails.num_rails);
+        double start = now_ms();
+        if (multirail_transfer(&rails, IBV_WR_RDMA_WRITE, 0, ctx.buffer_size) < 0) {
+            fprintf(stderr, "Multi-rail write failed\n");
+        } else {
+            double elapsed = now_ms() - start;
+            printf("✓ Multi-rail write: %.3f ms, %.2f GB/s aggregate\n",
+                   elapsed, ctx.buffer_size / (elapsed * 1e6));
+        }
+    }
+    
+    // Every further accelerator writes its buffer to its peer at once
+    if (num_extra) {
+        printf("\n--- Multi-accelerator RDMA Write Test ---\n");
+        printf("Writing on %d accelerator pair(s) in parallel...\n", num_extra);
+        uint64_t bytes;
+        double start = now_ms();
+        if (accel_transfer(accels, num_extra, 0, &bytes) < 0) {
+            fprintf(stderr, "Multi-accelerator write failed\n");
+        } else {
+            double elapsed = now_ms() - start;
+            printf("✓ Multi-accelerator write: %lu bytes, %.3f ms, %.2f GB/s aggregate\n",
+                   bytes, elapsed, bytes / (elapsed * 1e6));
+        }
+    }
+    
+    // Bulk RDMA Write that recovers the QP instead of tearing down
+    printf("\n--- Bulk RDMA Write Test ---\n");
+    rdma_xfer_t bulk = { .len = ctx.buffer_size, .checksum = use_crc };
+    printf("Writing %zu bytes in %d KB chunks...\n", bulk.len, XFER_CHUNK_SIZE / 1024);
+    if (xfer_write(&ctx, &bulk) < 0) {
+        fprintf(stderr, "Bulk write failed\n");
+    } else if (bulk.crc_errors) {
+        printf("⚠️  Bulk write completed, server found %lu bad chunk(s)\n", bulk.crc_errors);
+    } else {
+        printf("✓ Bulk write completed\n");
+    }
+    
+    // Pull the whole buffer back with many RDMA Reads in flight
+    printf("\n--- RDMA Read Engine Test ---\n");
+    rdma_xfer_t pull = { .len = ctx.buffer_size };
+    printf("Reading %zu bytes in %d KB chunks, %d reads in flight...\n",
+           pull.len, XFER_READ_CHUNK_SIZE / 1024, ctx.max_rd_atomic);
+    if (xfer_read(&ctx, &pull) < 0) {
+        fprintf(stderr, "Read engine failed\n");
+    } else {
+        printf("✓ Read engine completed\n");
+    }
+    
+    // GETs and CAS-locked PUTs against the server's KV store
+    if (use_kv) {
+        const int kv_ints = 64;
+        kv_client_t kv;
+        uint32_t type;
+        uint64_t seeded = 0;
+        
+        printf("\n--- One-sided KV Store Test ---\n");
+        if (recv_ctrl(&ctx, &type, &seeded) < 0 || seeded == 0) {
+            printf("Server has no KV store\n");
+        } else if (kv_client_init(&kv, &ctx) == 0) {
+            int value[kv_ints], bad = 0;
+            
+            // The second pass finds most keys through the location hints
+            double start = now_ms();
+            for (int pass = 0; pass < 2; pass++) {
+                for (uint64_t k = 1; k <= seeded; k++) {
+                    int n = kv_get(&kv, k, value, sizeof(value));
+                    if (n != (int)sizeof(value) || value[kv_ints - 1] != (int)(k * 1000 + kv_ints - 1)) bad++;
+                }
+            }
+            printf("%s %lu GETs, %.2f us average, %d bad\n", bad ? "✗" : "✓",
+                   2 * seeded, (now_ms() - start) * 1000.0 / (2 * seeded), bad);
+            
+            // Update the last seeded keys and insert as many new ones
+            uint64_t first = seeded > 16 ? seeded - 15 : 1, puts = seeded + 16 - first + 1;
+            bad = 0;
+            start = now_ms();
+            for (uint64_t k = first; k <= seeded + 16; k++) {
+                for (int j = 0; j < kv_ints; j++) value[j] = -(int)(k * 1000 + j);
+                if (kv_put(&kv, k, value, sizeof(value)) < 0) bad++;
+            }
+            double put_ms = now_ms() - start;
+            for (uint64_t k = first; k <= seeded + 16; k++) {
+                if (kv_get(&kv, k, value, sizeof(value)) != (int)sizeof(value) ||
+                    value[0] != -(int)(k * 1000)) {
+                    bad++;
+                }
+            }
+            printf("%s %lu PUTs, %.2f us average, %d bad after read-back\n", bad ? "✗" : "✓",
+                   puts, put_ms * 1000.0 / puts, bad);
+            kv_print_stats(&kv);
+        }
+        
+        // The server only waits for this when it seeded keys, even if our
+        // side failed to set up
+        if (seeded) send_ctrl(&ctx, CTRL_DONE, 0);
+    }
+    
+    // Hot-set reads of the server's buffer through the client-side cache
+    if (use_cache) {
+        rdma_cache_t cache;
+        uint32_t type;
+        uint64_t modified = 0;
+        int peer = -1;
+        size_t cache_size = ctx.buffer_size / 4 < (1 << 20) ? ctx.buffer_size / 4 : (1 << 20);
+        
+        printf("\n--- Client-side Cache Test ---\n");
+        if (cache_init(&cache, &ctx, ctx.buffer_size / 2, cache_size, 4096) == 0) {
+            peer = cache_add_peer(&cache, &ctx);
+        }
+        
+        // Tell the server where our epoch word for it lives
+        send_ctrl(&ctx, CTRL_EPOCH, peer >= 0 ? cache_epoch_offset(&cache, peer) : UINT64_MAX);
+        
+        if (peer >= 0) {
+            int failed = 0;
+            
+            // 90% of reads hit 16 hot pages, the rest sweep 48 cold ones
+            double start = now_ms();
+            for (int i = 0; i < 1000; i++) {
+                int page = i % 10 == 9 ? 16 + (i / 10) % 48 : i % 16;
+                if (!cache_read(&cache, peer, (uint64_t)page * 4096, 4096)) failed++;
+            }
+            printf("%s 1000 cached reads in %.3f ms, %d failed\n", failed ? "✗" : "✓",
+                   now_ms() - start, failed);
+            
+            // The server now changes page 0 and bumps our epoch
+            send_ctrl(&ctx, CTRL_DONE, 0);
+            if (recv_ctrl(&ctx, &type, &modified) == 0) {
+                uint64_t stale = cache.stale;
+                const int *page = cache_read(&cache, peer, 0, 4096);
+                
+                printf("%s Epoch bump forced a refetch\n", cache.stale > stale ? "✓" : "✗");
+                if (page && modified) {
+                    printf("%s Refetched page shows the server's update\n",
+                           page[0] == 7000000 ? "✓" : "✗");
+                }
+            }
+            cache_print_stats(&cache);
+        }
+        cache_destroy(&cache);
+    }
+    
+    // Write through a window the server granted, then check that the same
+    // write is rejected once the server has invalidated it
+    if (use_mw) {
+        struct mw_grant_t grant;
+        uint32_t type;
+        uint64_t value;
+        
+        printf("\n--- Memory Window Test ---\n");
+        if (mw_recv_grant(&ctx, &grant) < 0) {
+            fprintf(stderr, "Failed to receive window grant\n");
+        } else if (grant.len == 0) {
+            printf("Server could not bind a memory window\n");
+        } else {
+            printf("Granted window 0x%lx (+%lu bytes), rkey 0x%x\n", grant.addr, grant.len, grant.rkey);
+            
+            int failed = post_rdma_to(&ctx, IBV_WR_RDMA_WRITE, 0, grant.addr, grant.rkey,
+                                      grant.len, 0) || poll_completion(&ctx) < 0;
+            printf("%s Write through the window\n", failed ? "✗" : "✓");
+            send_ctrl(&ctx, CTRL_DONE, failed);
+            
+            if (recv_ctrl(&ctx, &type, &value) == 0) {
+                printf("Server revoked the window, writing again (expect an access error)...\n");
+                failed = post_rdma_to(&ctx, IBV_WR_RDMA_WRITE, 0, grant.addr, grant.rkey,
+                                      grant.len, 0) || poll_completion(&ctx) < 0;
+                printf("%s Write through the revoked window %s\n", failed ? "✓" : "✗",
+                       failed ? "was rejected" : "succeeded");
+            }
+        }
+    }
+    
+    // Round trips of small control messages over the UD endpoint
+    if (use_ud) {
+        const int pings = 100;
+        char msg[UD_MSG_SIZE];
+        int done = 0;
+        
+        printf("\n--- UD Control Messages Test ---\n");
+        double start = now_ms();
+        for (; done < pings; done++) {
+            int n = snprintf(msg, sizeof(msg), "P%d", done);
+            if (ud_send(&ud, ud_peer, msg, n) < 0 ||
+                ud_recv(&ud, NULL, msg, sizeof(msg), 1000) < 0) {
+                break;
+            }
+        }
+        if (done == pings) {
+            printf("✓ %d UD round trips, %.1f us average\n",
+                   pings, (now_ms() - start) * 1000.0 / pings);
+        } else {
+            fprintf(stderr, "UD round trip %d failed\n", done);
+        }
+    }
+    
     // Signal server we're done
     char sync_byte = 'D';
-    write(ctx.sock, &sync_byte, 1);
+    if (use_ud) {
+        if (ud_send(&ud, ud_peer, &sync_byte, 1) < 0 || ud_flush(&ud, ud_peer, 5000) < 0) {
+            fprintf(stderr, "Server did not acknowledge completion\n");
+        }
+    } else {
+        write(ctx.sock, &sync_byte, 1);
+    }
     
     // Print summary
     printf("\n=== Summary ===\n");
@@ -208,6 +534,21 @@ int main(int argc, char *argv[]) {
     } else {
         printf("✅ RDMA using regular memory\n");
         printf("   - Host buffer: %p\n", ctx.buffer);
+        if (ctx.odp_mode) print_odp_stats(&ctx);
+    }
+    if (rails.num_rails) {
+        printf("   - Rails: %d\n", rails.num_rails);
+        multirail_print(&rails);
+    }
+    print_xfer_stats("Bulk write", &bulk);
+    print_xfer_stats("Read engine", &pull);
+    printf("   - Outstanding RDMA Reads: %d as initiator, %d as responder\n",
+           ctx.max_rd_atomic, ctx.max_dest_rd_atomic);
+    if (use_ud) ud_print_stats(&ud);
+    if (num_extra) {
+        printf("   - Primary accelerator %s on NIC %s\n",
+               ctx.gaudi_bus_id[0] ? ctx.gaudi_bus_id : "(none)", ctx.ib_dev_name);
+        print_accelerators(accels, num_extra);
     }
     printf("\n📊 Operations Summary:\n");
     printf("   ✓ Send/Receive: 3 iterations (bidirectional)\n");
@@ -219,6 +560,9 @@ int main(int argc, char *argv[]) {
     printf("   - Minimal latency and maximum bandwidth\n");
     printf("   - CPU remains free for other tasks\n");
     
+    ud_destroy(&ud);
+    multirail_cleanup(&rails);
+    close_accelerators(accels, num_extra);
     cleanup_resources(&ctx);
     printf("\nClient shutdown complete\n");
     return 0;
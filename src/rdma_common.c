@@ -1,4 +1,37 @@
 #include "rdma_common.h"
+#include <linux/netlink.h>
+#include <rdma/rdma_netlink.h>
+
+// Allocate the host fallback buffer. With ODP requested the pages are left
+// untouched (anonymous mmap is zero-filled on first access), so neither the
+// allocation nor the registration has to fault in the whole buffer.
+static int alloc_host_buffer(rdma_context_t *ctx, size_t size) {
+    if (ctx->odp_mode != RDMA_ODP_OFF) {
+        ctx->buffer = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ctx->buffer == MAP_FAILED) {
+            ctx->buffer = NULL;
+            return -1;
+        }
+        ctx->buffer_mmapped = 1;
+        return 0;
+    }
+    
+    ctx->buffer = aligned_alloc(4096, size);
+    if (!ctx->buffer) return -1;
+    memset(ctx->buffer, 0, size);
+    return 0;
+}
+
+static void free_host_buffer(rdma_context_t *ctx) {
+    if (ctx->buffer_mmapped) {
+        munmap(ctx->buffer, ctx->buffer_size);
+    } else {
+        free(ctx->buffer);
+    }
+    ctx->buffer = NULL;
+    ctx->buffer_mmapped = 0;
+}
 
 // Initialize Gaudi device and allocate DMA-buf
 int init_gaudi_dmabuf(rdma_context_t *ctx, size_t size) {
@@ -12,16 +45,29 @@ int init_gaudi_dmabuf(rdma_context_t *ctx, size_t size) {
         HLTHUNK_DEVICE_DONT_CARE
     };
     
-    for (int i = 0; i < 4; i++) {
-        ctx->gaudi_fd = hlthunk_open(devices[i], NULL);
-        if (ctx->gaudi_fd >= 0) break;
+    if (ctx->gaudi_bus_id[0]) {
+        // A specific accelerator was requested
+        ctx->gaudi_fd = hlthunk_open(HLTHUNK_DEVICE_DONT_CARE, ctx->gaudi_bus_id);
+    } else {
+        for (int i = 0; i < 4; i++) {
+            ctx->gaudi_fd = hlthunk_open(devices[i], NULL);
+            if (ctx->gaudi_fd >= 0) break;
+        }
+        if (ctx->gaudi_fd >= 0 &&
+            hlthunk_get_pci_bus_id_from_fd(ctx->gaudi_fd, ctx->gaudi_bus_id,
+                                           sizeof(ctx->gaudi_bus_id)) != 0) {
+            ctx->gaudi_bus_id[0] = '\0';
+        }
     }
     
     if (ctx->gaudi_fd < 0) {
-        printf("No Gaudi device found, using regular memory\n");
-        ctx->buffer = aligned_alloc(4096, size);
-        if (!ctx->buffer) return -1;
-        memset(ctx->buffer, 0, size);
+        if (ctx->gaudi_bus_id[0]) {
+            printf("Gaudi %s not available, using regular memory\n", ctx->gaudi_bus_id);
+            ctx->gaudi_bus_id[0] = '\0';
+        } else {
+            printf("No Gaudi device found, using regular memory\n");
+        }
+        if (alloc_host_buffer(ctx, size)) return -1;
         ctx->dmabuf_fd = -1;
         return 0;
     }
@@ -33,7 +79,8 @@ int init_gaudi_dmabuf(rdma_context_t *ctx, size_t size) {
         return -1;
     }
     
-    printf("Gaudi device opened successfully\n");
+    printf("Gaudi device opened successfully%s%s\n",
+           ctx->gaudi_bus_id[0] ? " at " : "", ctx->gaudi_bus_id);
     
     // Allocate device memory
     ctx->gaudi_handle = hlthunk_device_memory_alloc(ctx->gaudi_fd, size, 0, true, true);
@@ -41,9 +88,7 @@ int init_gaudi_dmabuf(rdma_context_t *ctx, size_t size) {
         printf("Failed to allocate Gaudi memory, using regular memory\n");
         hlthunk_close(ctx->gaudi_fd);
         ctx->gaudi_fd = -1;
-        ctx->buffer = aligned_alloc(4096, size);
-        if (!ctx->buffer) return -1;
-        memset(ctx->buffer, 0, size);
+        if (alloc_host_buffer(ctx, size)) return -1;
         ctx->dmabuf_fd = -1;
         return 0;
     }
@@ -63,13 +108,11 @@ int init_gaudi_dmabuf(rdma_context_t *ctx, size_t size) {
     if (ctx->dmabuf_fd < 0) {
         printf("DMA-buf export failed, creating host-mapped buffer\n");
         // Fallback: allocate host memory and map it to Gaudi
-        ctx->buffer = aligned_alloc(4096, size);
-        if (!ctx->buffer) {
+        if (alloc_host_buffer(ctx, size)) {
             hlthunk_memory_unmap(ctx->gaudi_fd, ctx->device_va);
             hlthunk_device_memory_free(ctx->gaudi_fd, ctx->gaudi_handle);
             return -1;
         }
-        memset(ctx->buffer, 0, size);
         
         // Map host buffer to Gaudi's address space for CPU-HPU data transfer
         ctx->host_device_va = hlthunk_host_memory_map(ctx->gaudi_fd, ctx->buffer, 0, size);
@@ -95,8 +138,22 @@ int init_gaudi_dmabuf(rdma_context_t *ctx, size_t size) {
     return 0;
 }
 
+// Host memory only, for tools that need the CPU (and file I/O) to reach
+// the buffer
+int init_host_buffer(rdma_context_t *ctx, size_t size) {
+    ctx->buffer_size = size;
+    ctx->dmabuf_fd = -1;
+    return alloc_host_buffer(ctx, size);
+}
+
 // Helper function to clean up resources in case of failure
 static void cleanup_rdma_init_resources(rdma_context_t *ctx, struct ibv_device **dev_list) {
+    if (ctx->qp) ibv_destroy_qp(ctx->qp);
+    ctx->qp = NULL;
+    
+    if (ctx->remote_mr) ibv_dereg_mr(ctx->remote_mr);
+    ctx->remote_mr = NULL;
+    
     if (ctx->mr) ibv_dereg_mr(ctx->mr);
     ctx->mr = NULL;
     
@@ -112,12 +169,104 @@ static void cleanup_rdma_init_resources(rdma_context_t *ctx, struct ibv_device *
     if (dev_list) ibv_free_device_list(dev_list);
 }
 
-// Initialize RDMA resources
-int init_rdma_resources(rdma_context_t *ctx, const char *ib_dev_name) {
+// Register the host buffer as an On-Demand-Paging MR. Nothing is pinned here;
+// the NIC faults pages in as they are touched (or as odp_prefetch() asks).
+// Leaves ctx->mr NULL if the device has no usable RC ODP support.
+static void register_odp_mr(rdma_context_t *ctx, int mr_flags) {
+    struct ibv_device_attr_ex attr = {0};
+    uint32_t needed = IBV_ODP_SUPPORT_SEND | IBV_ODP_SUPPORT_RECV |
+                      IBV_ODP_SUPPORT_WRITE | IBV_ODP_SUPPORT_READ;
+    
+    if (ibv_query_device_ex(ctx->ib_ctx, NULL, &attr)) {
+        printf("ODP capability query failed, using pinned registration\n");
+        return;
+    }
+    
+    ctx->odp_rc_caps = attr.odp_caps.per_transport_caps.rc_odp_caps;
+    if (!(attr.odp_caps.general_caps & IBV_ODP_SUPPORT) ||
+        (ctx->odp_rc_caps & needed) != needed) {
+        printf("Device lacks RC ODP support, using pinned registration\n");
+        return;
+    }
+    
+    if (!(ctx->odp_rc_caps & IBV_ODP_SUPPORT_ATOMIC)) {
+        mr_flags &= ~IBV_ACCESS_REMOTE_ATOMIC;
+    }
+    mr_flags |= IBV_ACCESS_ON_DEMAND;
+    
+    int implicit_ok = attr.odp_caps.general_caps & IBV_ODP_SUPPORT_IMPLICIT;
+    double start = now_ms();
+    
+    // An implicit MR spans the whole address space, so it only ever serves
+    // local access; the peer gets the rkey of an MR over just the buffer
+    if (implicit_ok && ctx->odp_mode == RDMA_ODP_IMPLICIT) {
+        ctx->mr = ibv_reg_mr(ctx->pd, NULL, SIZE_MAX, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_ON_DEMAND);
+        if (ctx->mr) {
+            ctx->remote_mr = ibv_reg_mr(ctx->pd, ctx->buffer, ctx->buffer_size, mr_flags);
+            if (!ctx->remote_mr) {
+                ibv_dereg_mr(ctx->mr);
+                ctx->mr = NULL;
+            }
+        }
+        if (ctx->mr) {
+            ctx->odp_active = RDMA_ODP_IMPLICIT;
+        } else {
+            printf("Implicit ODP registration failed, trying explicit ODP\n");
+        }
+    } else if (ctx->odp_mode == RDMA_ODP_IMPLICIT) {
+        printf("Implicit ODP not supported, trying explicit ODP\n");
+    }
+    
+    if (!ctx->mr) {
+        ctx->mr = ibv_reg_mr(ctx->pd, ctx->buffer, ctx->buffer_size, mr_flags);
+        if (!ctx->mr) {
+            printf("ODP registration failed, using pinned registration\n");
+            return;
+        }
+        ctx->odp_active = RDMA_ODP_EXPLICIT;
+    }
+    
+    ctx->mr_reg_ms = now_ms() - start;
+    printf("%s ODP MR registered with IB (%.3f ms, nothing pinned)\n",
+           odp_mode_str(ctx->odp_active), ctx->mr_reg_ms);
+}
+
+// Create the RC QP on the context's PD and CQ
+int create_qp(rdma_context_t *ctx) {
+    uint32_t depth = RDMA_MAX_WR;
+    
+    if (ctx->dev_attr.max_qp_wr > 0 && depth > (uint32_t)ctx->dev_attr.max_qp_wr) {
+        depth = ctx->dev_attr.max_qp_wr;
+    }
+    
+    struct ibv_qp_init_attr qp_init_attr = {
+        .qp_type = IBV_QPT_RC,
+        .sq_sig_all = 1,
+        .send_cq = ctx->cq,
+        .recv_cq = ctx->cq,
+        .cap = {
+            .max_send_wr = depth,
+            .max_recv_wr = depth,
+            .max_send_sge = 1,
+            .max_recv_sge = 1
+        }
+    };
+    
+    ctx->qp = ibv_create_qp(ctx->pd, &qp_init_attr);
+    if (!ctx->qp) {
+        fprintf(stderr, "Failed to create QP\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Open the IB device and create PD, CQ and QP (unless ctx->no_qp). Needs
+// nothing from the accelerator, so it can run while the device memory is
+// being set up.
+int open_rdma_device(rdma_context_t *ctx, const char *ib_dev_name) {
     struct ibv_device **dev_list = NULL;
     struct ibv_device *ib_dev = NULL;
     int num_devices, i;
-    int result = -1;
     
     // Get device list
     dev_list = ibv_get_device_list(&num_devices);
@@ -149,14 +298,23 @@ int init_rdma_resources(rdma_context_t *ctx, const char *ib_dev_name) {
     }
     
     printf("Opened IB device: %s\n", ibv_get_device_name(ib_dev));
+    snprintf(ctx->ib_dev_name, sizeof(ctx->ib_dev_name), "%s", ibv_get_device_name(ib_dev));
     
     // Query port
-    if (ibv_query_port(ctx->ib_ctx, 1, &ctx->port_attr)) {
+    if (!ctx->ib_port) ctx->ib_port = 1;
+    if (ibv_query_port(ctx->ib_ctx, ctx->ib_port, &ctx->port_attr)) {
         fprintf(stderr, "Failed to query port\n");
         cleanup_rdma_init_resources(ctx, dev_list);
         return -1;
     }
     
+    // Query device limits (outstanding RDMA Read depth, queue sizes)
+    if (ibv_query_device(ctx->ib_ctx, &ctx->dev_attr)) {
+        fprintf(stderr, "Failed to query device\n");
+        cleanup_rdma_init_resources(ctx, dev_list);
+        return -1;
+    }
+    
     // Allocate PD
     ctx->pd = ibv_alloc_pd(ctx->ib_ctx);
     if (!ctx->pd) {
@@ -166,79 +324,132 @@ int init_rdma_resources(rdma_context_t *ctx, const char *ib_dev_name) {
     }
     
     // Create CQ
-    ctx->cq = ibv_create_cq(ctx->ib_ctx, 10, NULL, NULL, 0);
+    ctx->cq = ibv_create_cq(ctx->ib_ctx, RDMA_CQ_SIZE, NULL, NULL, 0);
     if (!ctx->cq) {
         fprintf(stderr, "Failed to create CQ\n");
         cleanup_rdma_init_resources(ctx, dev_list);
         return -1;
     }
     
+    // Create QP
+    if (!ctx->no_qp && create_qp(ctx)) {
+        cleanup_rdma_init_resources(ctx, dev_list);
+        return -1;
+    }
+    
+    ibv_free_device_list(dev_list);
+    return 0;
+}
+
+// Register the buffer with the opened device
+int register_rdma_memory(rdma_context_t *ctx) {
     // Register memory - ensure all access flags are set
     int mr_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | 
                    IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_ATOMIC;
     
+    // With windows the MR itself grants no remote access at all; the peer
+    // only ever gets window rkeys, which can be narrowed and revoked
+    if (ctx->mw_bind) mr_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_MW_BIND;
+    
     if (ctx->dmabuf_fd >= 0) {
         // Try direct DMA-buf registration
+        double start = now_ms();
         ctx->mr = ibv_reg_dmabuf_mr(ctx->pd, 0, ctx->buffer_size, 
                                     (uint64_t)ctx->device_va, ctx->dmabuf_fd, mr_flags);
         if (ctx->mr) {
+            ctx->mr_reg_ms = now_ms() - start;
             printf("DMA-buf registered successfully with IB\n");
         } else {
             printf("DMA-buf registration failed, trying fallback\n");
         }
     }
     
+    if (!ctx->mr && ctx->buffer && ctx->odp_mode != RDMA_ODP_OFF) {
+        register_odp_mr(ctx, mr_flags);
+    }
+    
     if (!ctx->mr && ctx->buffer) {
         // Register regular memory
+        double start = now_ms();
         ctx->mr = ibv_reg_mr(ctx->pd, ctx->buffer, ctx->buffer_size, mr_flags);
         if (!ctx->mr) {
             fprintf(stderr, "Failed to register memory\n");
-            cleanup_rdma_init_resources(ctx, dev_list);
             return -1;
         }
-        printf("Regular memory registered with IB\n");
+        ctx->mr_reg_ms = now_ms() - start;
+        printf("Regular memory registered with IB (%.3f ms)\n", ctx->mr_reg_ms);
     }
     
     if (!ctx->mr) {
         fprintf(stderr, "No memory could be registered\n");
-        cleanup_rdma_init_resources(ctx, dev_list);
         return -1;
     }
-    
-    // Create QP
-    struct ibv_qp_init_attr qp_init_attr = {
-        .qp_type = IBV_QPT_RC,
-        .sq_sig_all = 1,
-        .send_cq = ctx->cq,
-        .recv_cq = ctx->cq,
-        .cap = {
-            .max_send_wr = 10,
-            .max_recv_wr = 10,
-            .max_send_sge = 1,
-            .max_recv_sge = 1
-        }
-    };
-    
-    ctx->qp = ibv_create_qp(ctx->pd, &qp_init_attr);
-    if (!ctx->qp) {
-        fprintf(stderr, "Failed to create QP\n");
-        cleanup_rdma_init_resources(ctx, dev_list);
+    return 0;
+}
+
+// Initialize RDMA resources
+int init_rdma_resources(rdma_context_t *ctx, const char *ib_dev_name) {
+    if (open_rdma_device(ctx, ib_dev_name) < 0) {
         return -1;
     }
     
-    ibv_free_device_list(dev_list);
+    if (register_rdma_memory(ctx) < 0) {
+        cleanup_rdma_init_resources(ctx, NULL);
+        return -1;
+    }
     return 0;
 }
 
 // Socket operations for connection establishment
-static int sock_connect(const char *server_name, int port) {
+int sock_listen(int port) {
+    struct addrinfo hints = {0}, *res;
+    char port_str[6];
+    int sockfd, reuse = 1;
+    
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    
+    sprintf(port_str, "%d", port);
+    if (getaddrinfo(NULL, port_str, &hints, &res)) {
+        return -1;
+    }
+    
+    sockfd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (sockfd < 0) {
+        freeaddrinfo(res);
+        return -1;
+    }
+    
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(sockfd, res->ai_addr, res->ai_addrlen) || listen(sockfd, 16)) {
+        close(sockfd);
+        freeaddrinfo(res);
+        return -1;
+    }
+    
+    freeaddrinfo(res);
+    return sockfd;
+}
+
+// Client: connect to server_name. Server (server_name == NULL): accept one
+// connection on port.
+int sock_connect(const char *server_name, int port) {
     struct addrinfo hints = {0}, *res;
     char port_str[6];
     int sockfd;
     
+    if (!server_name) {
+        int listen_fd = sock_listen(port);
+        if (listen_fd < 0) return -1;
+        
+        sockfd = accept(listen_fd, NULL, NULL);
+        close(listen_fd);
+        return sockfd;
+    }
+    
     hints.ai_family = AF_INET;
     hints.ai_socktype = SOCK_STREAM;
-    if (!server_name) hints.ai_flags = AI_PASSIVE;
     
     sprintf(port_str, "%d", port);
     if (getaddrinfo(server_name, port_str, &hints, &res)) {
@@ -251,28 +462,10 @@ static int sock_connect(const char *server_name, int port) {
         return -1;
     }
     
-    if (server_name) {
-        // Client: connect
-        if (connect(sockfd, res->ai_addr, res->ai_addrlen)) {
-            close(sockfd);
-            freeaddrinfo(res);
-            return -1;
-        }
-    } else {
-        // Server: bind and listen
-        int reuse = 1;
-        setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
-        
-        if (bind(sockfd, res->ai_addr, res->ai_addrlen)) {
-            close(sockfd);
-            freeaddrinfo(res);
-            return -1;
-        }
-        
-        listen(sockfd, 1);
-        int client_fd = accept(sockfd, NULL, NULL);
+    if (connect(sockfd, res->ai_addr, res->ai_addrlen)) {
         close(sockfd);
-        sockfd = client_fd;
+        freeaddrinfo(res);
+        return -1;
     }
     
     freeaddrinfo(res);
@@ -286,10 +479,10 @@ static int sock_sync_data(int sock, size_t size, void *local_data, void *remote_
 }
 
 // Modify QP state machine
-static int modify_qp_to_init(struct ibv_qp *qp) {
+static int modify_qp_to_init(struct ibv_qp *qp, uint8_t port) {
     struct ibv_qp_attr attr = {
         .qp_state = IBV_QPS_INIT,
-        .port_num = 1,
+        .port_num = port,
         .pkey_index = 0,
         .qp_access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | 
                           IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_ATOMIC
@@ -297,28 +490,32 @@ static int modify_qp_to_init(struct ibv_qp *qp) {
     return ibv_modify_qp(qp, &attr, IBV_QP_STATE | IBV_QP_PKEY_INDEX | IBV_QP_PORT | IBV_QP_ACCESS_FLAGS);
 }
 
-static int modify_qp_to_rtr(struct ibv_qp *qp, uint32_t remote_qpn, uint16_t dlid, uint8_t *dgid) {
+static int modify_qp_to_rtr(rdma_context_t *ctx, uint32_t remote_qpn,
+                            uint16_t dlid, uint8_t *dgid) {
+    struct ibv_qp *qp = ctx->qp;
+    uint8_t port = ctx->ib_port;
     struct ibv_qp_attr attr = {
         .qp_state = IBV_QPS_RTR,
-        .path_mtu = IBV_MTU_4096,
+        .path_mtu = ctx->path_mtu,
         .dest_qp_num = remote_qpn,
         .rq_psn = 0,
-        .max_dest_rd_atomic = 1,
+        .max_dest_rd_atomic = ctx->max_dest_rd_atomic,
         .min_rnr_timer = 12,
         .ah_attr = {
             .is_global = 0,
             .dlid = dlid,
             .sl = 0,
             .src_path_bits = 0,
-            .port_num = 1
+            .port_num = port
         }
     };
     
     if (dgid && memcmp(dgid, "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0", 16)) {
         attr.ah_attr.is_global = 1;
         memcpy(&attr.ah_attr.grh.dgid, dgid, 16);
-        attr.ah_attr.grh.sgid_index = 0;
-        attr.ah_attr.grh.hop_limit = 1;
+        attr.ah_attr.grh.sgid_index = ctx->gid_index;
+        attr.ah_attr.grh.hop_limit = ctx->gid_is_rocev2 ? 64 : 1;
+        attr.ah_attr.grh.traffic_class = ctx->traffic_class;
     }
     
     return ibv_modify_qp(qp, &attr, IBV_QP_STATE | IBV_QP_AV | IBV_QP_PATH_MTU |
@@ -326,36 +523,100 @@ static int modify_qp_to_rtr(struct ibv_qp *qp, uint32_t remote_qpn, uint16_t dli
                          IBV_QP_MIN_RNR_TIMER);
 }
 
-static int modify_qp_to_rts(struct ibv_qp *qp) {
+static int modify_qp_to_rts(rdma_context_t *ctx) {
     struct ibv_qp_attr attr = {
         .qp_state = IBV_QPS_RTS,
-        .timeout = 14,
-        .retry_cnt = 7,
+        .timeout = ctx->qp_timeout,
+        .retry_cnt = ctx->qp_retry_cnt,
         .rnr_retry = 7,
         .sq_psn = 0,
-        .max_rd_atomic = 1
+        .max_rd_atomic = ctx->max_rd_atomic
     };
-    return ibv_modify_qp(qp, &attr, IBV_QP_STATE | IBV_QP_TIMEOUT | IBV_QP_RETRY_CNT |
+    return ibv_modify_qp(ctx->qp, &attr, IBV_QP_STATE | IBV_QP_TIMEOUT | IBV_QP_RETRY_CNT |
                          IBV_QP_RNR_RETRY | IBV_QP_SQ_PSN | IBV_QP_MAX_QP_RD_ATOMIC);
 }
 
-// Connect QP
-int connect_qp(rdma_context_t *ctx, const char *server_name, int port) {
-    struct cm_con_data_t local_con_data = {0}, remote_con_data = {0};
-    union ibv_gid my_gid = {0};
-    char temp_char;
+// Pick the source GID. Unless an index was given, prefer a RoCEv2 entry with
+// an IPv4-mapped address, then any RoCEv2 entry, then index 0 (RoCEv1).
+static void select_gid(rdma_context_t *ctx, union ibv_gid *gid) {
+    int best = -1, best_rank = -1;
     
-    // Connect socket
-    ctx->sock = sock_connect(server_name, port);
-    if (ctx->sock < 0) {
-        fprintf(stderr, "Failed to establish TCP connection\n");
-        return -1;
+    for (int i = 0; !ctx->gid_index_set && i < ctx->port_attr.gid_tbl_len; i++) {
+        struct ibv_gid_entry entry;
+        int rank;
+        
+        if (ibv_query_gid_ex(ctx->ib_ctx, ctx->ib_port, i, &entry, 0)) continue;
+        if (entry.gid_type != IBV_GID_TYPE_ROCE_V2) continue;
+        
+        // ::ffff:a.b.c.d
+        rank = (entry.gid.global.subnet_prefix == 0 &&
+                (be64toh(entry.gid.global.interface_id) >> 32) == 0xffff) ? 2 : 1;
+        if (rank > best_rank) {
+            best_rank = rank;
+            best = i;
+        }
+    }
+    
+    if (!ctx->gid_index_set) {
+        ctx->gid_index = best >= 0 ? best : 0;
+        ctx->gid_is_rocev2 = best >= 0;
+    } else {
+        struct ibv_gid_entry entry;
+        ctx->gid_is_rocev2 = !ibv_query_gid_ex(ctx->ib_ctx, ctx->ib_port, ctx->gid_index, &entry, 0) &&
+                             entry.gid_type == IBV_GID_TYPE_ROCE_V2;
     }
     
-    // Get local GID if using RoCE
+    ibv_query_gid(ctx->ib_ctx, ctx->ib_port, ctx->gid_index, gid);
+}
+
+// GID this port is reached at: selected as above on RoCE, zero on IB where
+// the LID alone routes
+void query_local_gid(rdma_context_t *ctx, union ibv_gid *gid) {
+    memset(gid, 0, sizeof(*gid));
     if (ctx->port_attr.link_layer == IBV_LINK_LAYER_ETHERNET) {
-        ibv_query_gid(ctx->ib_ctx, 1, 0, &my_gid);
+        select_gid(ctx, gid);
     }
+}
+
+// Wire format of the GID in use; both ends of a connection must agree
+static uint8_t local_gid_type(rdma_context_t *ctx) {
+    if (ctx->port_attr.link_layer != IBV_LINK_LAYER_ETHERNET) return IBV_GID_TYPE_IB;
+    return ctx->gid_is_rocev2 ? IBV_GID_TYPE_ROCE_V2 : IBV_GID_TYPE_ROCE_V1;
+}
+
+static const char *gid_type_str(uint8_t type) {
+    switch (type) {
+    case IBV_GID_TYPE_ROCE_V1: return "RoCEv1";
+    case IBV_GID_TYPE_ROCE_V2: return "RoCEv2";
+    default:                   return "InfiniBand";
+    }
+}
+
+size_t mtu_bytes(enum ibv_mtu mtu) {
+    return mtu ? (size_t)128 << mtu : 4096;
+}
+
+static uint8_t min_rd_atomic(uint8_t a, uint8_t b) {
+    uint8_t m = a < b ? a : b;
+    return m ? m : 1;
+}
+
+// The rkey the peer may use on our buffer; none if access goes through
+// memory windows
+static uint32_t published_rkey(rdma_context_t *ctx) {
+    if (ctx->mw_bind) return 0;
+    return ctx->remote_mr ? ctx->remote_mr->rkey : ctx->mr->rkey;
+}
+
+// Exchange QP info over the established socket and bring the QP to RTS
+static int exchange_qp_info(rdma_context_t *ctx) {
+    struct cm_con_data_t local_con_data = {0}, remote_con_data = {0};
+    union ibv_gid my_gid;
+    char temp_char;
+    
+    query_local_gid(ctx, &my_gid);
+    if (!ctx->qp_timeout) ctx->qp_timeout = RDMA_QP_TIMEOUT;
+    if (!ctx->qp_retry_cnt) ctx->qp_retry_cnt = RDMA_QP_RETRY_CNT;
     
     // Prepare local connection data
     if (ctx->dmabuf_fd >= 0) {
@@ -363,10 +624,20 @@ int connect_qp(rdma_context_t *ctx, const char *server_name, int port) {
     } else {
         local_con_data.addr = htonll((uintptr_t)ctx->buffer);
     }
-    local_con_data.rkey = htonl(ctx->mr->rkey);
+    local_con_data.rkey = htonl(published_rkey(ctx));
     local_con_data.qp_num = htonl(ctx->qp->qp_num);
     local_con_data.lid = htons(ctx->port_attr.lid);
     memcpy(local_con_data.gid, &my_gid, 16);
+    local_con_data.max_rd_atomic = ctx->dev_attr.max_qp_init_rd_atom > 255 ? 255 :
+                                   ctx->dev_attr.max_qp_init_rd_atom;
+    local_con_data.max_dest_rd_atomic = ctx->dev_attr.max_qp_rd_atom > 255 ? 255 :
+                                        ctx->dev_attr.max_qp_rd_atom;
+    local_con_data.mtu = ctx->port_attr.active_mtu;
+    local_con_data.gid_index = ctx->gid_index;
+    local_con_data.gid_type = local_gid_type(ctx);
+    local_con_data.traffic_class = ctx->traffic_class;
+    local_con_data.timeout = ctx->qp_timeout;
+    local_con_data.retry_cnt = ctx->qp_retry_cnt;
     
     // Exchange connection data
     if (sock_sync_data(ctx->sock, sizeof(struct cm_con_data_t), 
@@ -375,26 +646,64 @@ int connect_qp(rdma_context_t *ctx, const char *server_name, int port) {
         return -1;
     }
     
+    // A RoCEv1/v2 mismatch would otherwise only show up as an RTR failure
+    // or retry-exceeded errors on the first transfer
+    if (remote_con_data.gid_type != local_con_data.gid_type) {
+        fprintf(stderr, "GID type mismatch: local GID index %d is %s, peer GID index %d is %s "
+                "(pick matching entries with -x)\n",
+                local_con_data.gid_index, gid_type_str(local_con_data.gid_type),
+                remote_con_data.gid_index, gid_type_str(remote_con_data.gid_type));
+        return -1;
+    }
+    
     // Save remote properties
     ctx->remote_props.addr = ntohll(remote_con_data.addr);
     ctx->remote_props.rkey = ntohl(remote_con_data.rkey);
     ctx->remote_props.qp_num = ntohl(remote_con_data.qp_num);
     ctx->remote_props.lid = ntohs(remote_con_data.lid);
     memcpy(ctx->remote_props.gid, remote_con_data.gid, 16);
+    ctx->remote_props.max_rd_atomic = remote_con_data.max_rd_atomic;
+    ctx->remote_props.max_dest_rd_atomic = remote_con_data.max_dest_rd_atomic;
+    
+    // Outstanding RDMA Reads: what we may initiate is bounded by what the
+    // peer can respond to, and vice versa
+    ctx->max_rd_atomic = min_rd_atomic(local_con_data.max_rd_atomic,
+                                       remote_con_data.max_dest_rd_atomic);
+    ctx->max_dest_rd_atomic = min_rd_atomic(local_con_data.max_dest_rd_atomic,
+                                            remote_con_data.max_rd_atomic);
+    
+    // Path parameters: the largest MTU both ports run, the more patient
+    // timeout/retry of the two, and whichever traffic class was asked for
+    ctx->remote_props.mtu = remote_con_data.mtu;
+    ctx->remote_props.gid_index = remote_con_data.gid_index;
+    ctx->remote_props.gid_type = remote_con_data.gid_type;
+    ctx->remote_props.traffic_class = remote_con_data.traffic_class;
+    ctx->remote_props.timeout = remote_con_data.timeout;
+    ctx->remote_props.retry_cnt = remote_con_data.retry_cnt;
+    ctx->path_mtu = remote_con_data.mtu && remote_con_data.mtu < local_con_data.mtu ?
+                    remote_con_data.mtu : local_con_data.mtu;
+    if (remote_con_data.timeout > ctx->qp_timeout) ctx->qp_timeout = remote_con_data.timeout;
+    if (remote_con_data.retry_cnt > ctx->qp_retry_cnt) ctx->qp_retry_cnt = remote_con_data.retry_cnt;
+    if (remote_con_data.traffic_class > ctx->traffic_class) {
+        ctx->traffic_class = remote_con_data.traffic_class;
+    }
+    printf("Path: MTU %zu, GID index %d%s, traffic class %d, timeout %d, retry %d\n",
+           mtu_bytes(ctx->path_mtu), ctx->gid_index, ctx->gid_is_rocev2 ? " (RoCEv2)" : "",
+           ctx->traffic_class, ctx->qp_timeout, ctx->qp_retry_cnt);
     
     // Modify QP states
-    if (modify_qp_to_init(ctx->qp)) {
+    if (modify_qp_to_init(ctx->qp, ctx->ib_port)) {
         fprintf(stderr, "Failed to modify QP to INIT\n");
         return -1;
     }
     
-    if (modify_qp_to_rtr(ctx->qp, ctx->remote_props.qp_num, 
+    if (modify_qp_to_rtr(ctx, ctx->remote_props.qp_num,
                          ctx->remote_props.lid, ctx->remote_props.gid)) {
         fprintf(stderr, "Failed to modify QP to RTR\n");
         return -1;
     }
     
-    if (modify_qp_to_rts(ctx->qp)) {
+    if (modify_qp_to_rts(ctx)) {
         fprintf(stderr, "Failed to modify QP to RTS\n");
         return -1;
     }
@@ -408,10 +717,67 @@ int connect_qp(rdma_context_t *ctx, const char *server_name, int port) {
     return 0;
 }
 
+// Connect QP
+int connect_qp(rdma_context_t *ctx, const char *server_name, int port) {
+    // Connect socket, unless the caller already established it
+    if (ctx->sock < 0) {
+        ctx->sock = sock_connect(server_name, port);
+        if (ctx->sock < 0) {
+            fprintf(stderr, "Failed to establish TCP connection\n");
+            return -1;
+        }
+    }
+    
+    return exchange_qp_info(ctx);
+}
+
+// Recover a QP that went to the error state without touching the MR, PD or
+// buffer: RESET, drop the flushed completions, then redo the handshake on the
+// still-open socket. Both peers must call this; any posted receives are gone.
+int reconnect_qp(rdma_context_t *ctx) {
+    struct ibv_qp_attr attr = { .qp_state = IBV_QPS_RESET };
+    struct ibv_wc wc[16];
+    
+    if (ibv_modify_qp(ctx->qp, &attr, IBV_QP_STATE)) {
+        fprintf(stderr, "Failed to modify QP to RESET\n");
+        return -1;
+    }
+    
+    while (ibv_poll_cq(ctx->cq, 16, wc) > 0)
+        ;
+    
+    return exchange_qp_info(ctx);
+}
+
+// Control channel messages on the TCP socket
+int send_ctrl(rdma_context_t *ctx, uint32_t type, uint64_t value) {
+    struct ctrl_msg_t msg = { .type = htonl(type), .value = htonll(value) };
+    return write(ctx->sock, &msg, sizeof(msg)) == sizeof(msg) ? 0 : -1;
+}
+
+int recv_ctrl(rdma_context_t *ctx, uint32_t *type, uint64_t *value) {
+    struct ctrl_msg_t msg;
+    size_t got = 0;
+    
+    while (got < sizeof(msg)) {
+        ssize_t n = read(ctx->sock, (char *)&msg + got, sizeof(msg) - got);
+        if (n <= 0) return -1;
+        got += n;
+    }
+    *type = ntohl(msg.type);
+    *value = ntohll(msg.value);
+    return 0;
+}
+
+// Address of the registered buffer as seen by the NIC
+uint64_t buffer_addr(rdma_context_t *ctx) {
+    return ctx->dmabuf_fd >= 0 ? ctx->device_va : (uintptr_t)ctx->buffer;
+}
+
 // Post send operation
 int post_send(rdma_context_t *ctx, int opcode) {
     struct ibv_sge sge = {
-        .addr = ctx->dmabuf_fd >= 0 ? ctx->device_va : (uintptr_t)ctx->buffer,
+        .addr = buffer_addr(ctx),
         .length = MSG_SIZE,
         .lkey = ctx->mr->lkey
     };
@@ -429,6 +795,72 @@ int post_send(rdma_context_t *ctx, int opcode) {
         sr.wr.rdma.rkey = ctx->remote_props.rkey;
     }
     
+    if (ctx->odp_active) {
+        odp_prefetch(ctx, (void *)(uintptr_t)sge.addr, sge.length,
+                     opcode == IBV_WR_RDMA_READ);
+    }
+    
+    struct ibv_send_wr *bad_wr;
+    return ibv_post_send(ctx->qp, &sr, &bad_wr);
+}
+
+// Post a one-sided operation between offsets of the local and remote buffers
+int post_rdma_range(rdma_context_t *ctx, int opcode, uint64_t local_off,
+                    uint64_t remote_off, uint32_t len, uint64_t wr_id) {
+    return post_rdma_to(ctx, opcode, local_off, ctx->remote_props.addr + remote_off,
+                        ctx->remote_props.rkey, len, wr_id);
+}
+
+// Post a one-sided operation against an explicit remote address and rkey,
+// e.g. a memory window the peer granted
+int post_rdma_to(rdma_context_t *ctx, int opcode, uint64_t local_off,
+                 uint64_t remote_addr, uint32_t rkey, uint32_t len, uint64_t wr_id) {
+    struct ibv_sge sge = {
+        .addr = buffer_addr(ctx) + local_off,
+        .length = len,
+        .lkey = ctx->mr->lkey
+    };
+    
+    struct ibv_send_wr sr = {
+        .wr_id = wr_id,
+        .sg_list = &sge,
+        .num_sge = 1,
+        .opcode = opcode,
+        .send_flags = IBV_SEND_SIGNALED,
+    };
+    sr.wr.rdma.remote_addr = remote_addr;
+    sr.wr.rdma.rkey = rkey;
+    
+    if (ctx->odp_active) {
+        odp_prefetch(ctx, (void *)(uintptr_t)sge.addr, len, opcode == IBV_WR_RDMA_READ);
+    }
+    
+    struct ibv_send_wr *bad_wr;
+    return ibv_post_send(ctx->qp, &sr, &bad_wr);
+}
+
+// Post an 8-byte atomic (compare-and-swap or fetch-and-add); the original
+// remote value lands at local_off
+int post_atomic(rdma_context_t *ctx, int opcode, uint64_t local_off, uint64_t remote_addr,
+                uint32_t rkey, uint64_t compare_add, uint64_t swap, uint64_t wr_id) {
+    struct ibv_sge sge = {
+        .addr = buffer_addr(ctx) + local_off,
+        .length = sizeof(uint64_t),
+        .lkey = ctx->mr->lkey
+    };
+    
+    struct ibv_send_wr sr = {
+        .wr_id = wr_id,
+        .sg_list = &sge,
+        .num_sge = 1,
+        .opcode = opcode,
+        .send_flags = IBV_SEND_SIGNALED,
+    };
+    sr.wr.atomic.remote_addr = remote_addr;
+    sr.wr.atomic.rkey = rkey;
+    sr.wr.atomic.compare_add = compare_add;
+    sr.wr.atomic.swap = swap;
+    
     struct ibv_send_wr *bad_wr;
     return ibv_post_send(ctx->qp, &sr, &bad_wr);
 }
@@ -436,7 +868,7 @@ int post_send(rdma_context_t *ctx, int opcode) {
 // Post receive operation
 int post_receive(rdma_context_t *ctx) {
     struct ibv_sge sge = {
-        .addr = ctx->dmabuf_fd >= 0 ? ctx->device_va : (uintptr_t)ctx->buffer,
+        .addr = buffer_addr(ctx),
         .length = MSG_SIZE,
         .lkey = ctx->mr->lkey
     };
@@ -447,10 +879,45 @@ int post_receive(rdma_context_t *ctx) {
         .num_sge = 1,
     };
     
+    if (ctx->odp_active) {
+        odp_prefetch(ctx, (void *)(uintptr_t)sge.addr, sge.length, 1);
+    }
+    
     struct ibv_recv_wr *bad_wr;
     return ibv_post_recv(ctx->qp, &rr, &bad_wr);
 }
 
+// RDMA Write with a 32-bit immediate (host order here, network order on
+// the wire) that completes a receive on the peer
+int post_write_imm(rdma_context_t *ctx, uint64_t local_off, uint64_t remote_off,
+                   uint32_t len, uint32_t imm, uint64_t wr_id) {
+    struct ibv_sge sge = {
+        .addr = buffer_addr(ctx) + local_off,
+        .length = len,
+        .lkey = ctx->mr->lkey
+    };
+    
+    struct ibv_send_wr sr = {
+        .wr_id = wr_id,
+        .sg_list = &sge,
+        .num_sge = 1,
+        .opcode = IBV_WR_RDMA_WRITE_WITH_IMM,
+        .send_flags = IBV_SEND_SIGNALED,
+        .imm_data = htonl(imm)
+    };
+    sr.wr.rdma.remote_addr = ctx->remote_props.addr + remote_off;
+    sr.wr.rdma.rkey = ctx->remote_props.rkey;
+    
+    struct ibv_send_wr *bad_wr;
+    return ibv_post_send(ctx->qp, &sr, &bad_wr);
+}
+
+// Write-with-immediate consumes a receive but places no data through it
+int post_imm_receive(rdma_context_t *ctx) {
+    struct ibv_recv_wr rr = { .wr_id = 0, .sg_list = NULL, .num_sge = 0 }, *bad_wr;
+    return ibv_post_recv(ctx->qp, &rr, &bad_wr);
+}
+
 // Poll for completion
 int poll_completion(rdma_context_t *ctx) {
     struct ibv_wc wc;
@@ -476,13 +943,309 @@ int poll_completion(rdma_context_t *ctx) {
     return -1;
 }
 
-// Cleanup resources
-void cleanup_resources(rdma_context_t *ctx) {
+// ODP helpers
+int parse_odp_mode(const char *str) {
+    if (strcmp(str, "off") == 0) return RDMA_ODP_OFF;
+    if (strcmp(str, "auto") == 0) return RDMA_ODP_AUTO;
+    if (strcmp(str, "explicit") == 0) return RDMA_ODP_EXPLICIT;
+    if (strcmp(str, "implicit") == 0) return RDMA_ODP_IMPLICIT;
+    return -1;
+}
+
+const char *odp_mode_str(int mode) {
+    switch (mode) {
+    case RDMA_ODP_AUTO:     return "Auto";
+    case RDMA_ODP_EXPLICIT: return "Explicit";
+    case RDMA_ODP_IMPLICIT: return "Implicit";
+    default:                return "Off";
+    }
+}
+
+// Fault a range into the NIC page tables right before it is transferred, so
+// the first packets don't stall on a network page fault. Synchronous (FLUSH).
+int odp_prefetch(rdma_context_t *ctx, void *addr, size_t len, int for_write) {
+    if (!ctx->odp_active || !len) return 0;
+    
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)addr,
+        .length = len,
+        .lkey = ctx->mr->lkey
+    };
+    enum ibv_advise_mr_advice advice = for_write ? IBV_ADVISE_MR_ADVICE_PREFETCH_WRITE
+                                                 : IBV_ADVISE_MR_ADVICE_PREFETCH;
+    
+    int ret = ibv_advise_mr(ctx->pd, advice, IBV_ADVISE_MR_FLAG_FLUSH, &sge, 1);
+    if (ret) {
+        fprintf(stderr, "ODP prefetch failed: %s\n", strerror(ret));
+        return -1;
+    }
+    
+    ctx->odp_prefetch_count++;
+    ctx->odp_prefetch_bytes += len;
+    return 0;
+}
+
+// The NIC's ODP faults are resolved by the kernel, outside this process's
+// fault accounting; they are only visible as per-MR driver statistics over
+// RDMA netlink (mlx5: page_faults, page_invalidations)
+#define NL_BUF_SIZE (64 * 1024)
+
+typedef struct {
+    struct nlmsghdr nlh;
+    char attrs[64];
+} nl_req_t;
+
+typedef struct {
+    const char *name;
+    uint32_t index;
+    int found;
+} nl_dev_match_t;
+
+typedef struct {
+    uint32_t pid;
+    uint64_t length;
+    uint32_t lkey;
+    uint32_t mrn;
+    int found;
+} odp_mr_match_t;
+
+typedef struct {
+    uint64_t page_faults;
+    uint64_t page_invalidations;
+    int found;
+} odp_counters_t;
+
+static int nla_ok(const struct nlattr *a, int rem) {
+    return rem >= NLA_HDRLEN && a->nla_len >= NLA_HDRLEN && a->nla_len <= rem;
+}
+
+static const struct nlattr *nla_next(const struct nlattr *a, int *rem) {
+    *rem -= NLA_ALIGN(a->nla_len);
+    return (const struct nlattr *)((const char *)a + NLA_ALIGN(a->nla_len));
+}
+
+#define nla_type(a) ((a)->nla_type & NLA_TYPE_MASK)
+#define nla_data(a) ((const char *)(a) + NLA_HDRLEN)
+#define nla_plen(a) ((int)(a)->nla_len - NLA_HDRLEN)
+#define nla_for_each(a, data, len, rem) \
+    for (a = (const struct nlattr *)(data), rem = (len); nla_ok(a, rem); a = nla_next(a, &rem))
+
+static const struct nlattr *nla_find(const void *data, int len, int type) {
+    const struct nlattr *a;
+    int rem;
+    
+    nla_for_each(a, data, len, rem) {
+        if (nla_type(a) == type) return a;
+    }
+    return NULL;
+}
+
+static uint32_t nla_u32(const struct nlattr *a) {
+    uint32_t v;
+    memcpy(&v, nla_data(a), sizeof(v));
+    return v;
+}
+
+static uint64_t nla_u64(const struct nlattr *a) {
+    uint64_t v;
+    memcpy(&v, nla_data(a), sizeof(v));
+    return v;
+}
+
+static void nldev_req_init(nl_req_t *req, int cmd, int dump) {
+    memset(req, 0, sizeof(*req));
+    req->nlh.nlmsg_len = NLMSG_HDRLEN;
+    req->nlh.nlmsg_type = RDMA_NL_GET_TYPE(RDMA_NL_NLDEV, cmd);
+    req->nlh.nlmsg_flags = NLM_F_REQUEST | (dump ? NLM_F_DUMP : 0);
+    req->nlh.nlmsg_seq = 1;
+}
+
+static void nldev_put_u32(nl_req_t *req, int type, uint32_t val) {
+    struct nlattr *a = (struct nlattr *)((char *)&req->nlh + NLMSG_ALIGN(req->nlh.nlmsg_len));
+    
+    a->nla_type = type;
+    a->nla_len = NLA_HDRLEN + sizeof(val);
+    memcpy((char *)a + NLA_HDRLEN, &val, sizeof(val));
+    req->nlh.nlmsg_len = NLMSG_ALIGN(req->nlh.nlmsg_len) + NLA_ALIGN(a->nla_len);
+}
+
+// Send one nldev request and hand the attributes of every reply message to
+// fn; a dump runs until NLMSG_DONE, a plain request stops after one reply
+static int nldev_query(nl_req_t *req, void (*fn)(const void *attrs, int len, void *arg),
+                       void *arg) {
+    struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+    int dump = req->nlh.nlmsg_flags & NLM_F_DUMP;
+    int fd, ret = -1, done = 0;
+    char *buf;
+    
+    fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_RDMA);
+    if (fd < 0) return -1;
+    buf = malloc(NL_BUF_SIZE);
+    if (!buf || sendto(fd, req, req->nlh.nlmsg_len, 0,
+                       (struct sockaddr *)&kernel, sizeof(kernel)) < 0) {
+        goto out;
+    }
+    
+    while (!done) {
+        ssize_t n = recv(fd, buf, NL_BUF_SIZE, 0);
+        if (n <= 0) goto out;
+        
+        for (struct nlmsghdr *nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, n);
+             nh = NLMSG_NEXT(nh, n)) {
+            if (nh->nlmsg_seq != req->nlh.nlmsg_seq) continue;
+            if (nh->nlmsg_type == NLMSG_DONE) {
+                done = 1;
+                break;
+            }
+            if (nh->nlmsg_type == NLMSG_ERROR) {
+                struct nlmsgerr *err = NLMSG_DATA(nh);
+                if (err->error) goto out;
+                done = 1;
+                break;
+            }
+            fn(NLMSG_DATA(nh), NLMSG_PAYLOAD(nh, 0), arg);
+            if (!dump) done = 1;
+        }
+    }
+    ret = 0;
+    
+out:
+    free(buf);
+    close(fd);
+    return ret;
+}
+
+static void match_dev(const void *attrs, int len, void *arg) {
+    nl_dev_match_t *d = arg;
+    const struct nlattr *name = nla_find(attrs, len, RDMA_NLDEV_ATTR_DEV_NAME);
+    const struct nlattr *idx = nla_find(attrs, len, RDMA_NLDEV_ATTR_DEV_INDEX);
+    
+    if (name && idx && strcmp(nla_data(name), d->name) == 0) {
+        d->index = nla_u32(idx);
+        d->found = 1;
+    }
+}
+
+// MRs are matched on owner pid and length; the lkey is only reported to
+// CAP_NET_ADMIN, but is checked when it is there
+static void match_mr(const void *attrs, int len, void *arg) {
+    odp_mr_match_t *m = arg;
+    const struct nlattr *table = nla_find(attrs, len, RDMA_NLDEV_ATTR_RES_MR);
+    const struct nlattr *e;
+    int rem;
+    
+    if (!table || m->found) return;
+    nla_for_each(e, nla_data(table), nla_plen(table), rem) {
+        const struct nlattr *pid = nla_find(nla_data(e), nla_plen(e), RDMA_NLDEV_ATTR_RES_PID);
+        const struct nlattr *mrlen = nla_find(nla_data(e), nla_plen(e), RDMA_NLDEV_ATTR_RES_MRLEN);
+        const struct nlattr *lkey = nla_find(nla_data(e), nla_plen(e), RDMA_NLDEV_ATTR_RES_LKEY);
+        const struct nlattr *mrn = nla_find(nla_data(e), nla_plen(e), RDMA_NLDEV_ATTR_RES_MRN);
+        
+        if (!pid || !mrlen || !mrn) continue;
+        if (nla_u32(pid) != m->pid || nla_u64(mrlen) != m->length) continue;
+        if (lkey && nla_u32(lkey) != m->lkey) continue;
+        m->mrn = nla_u32(mrn);
+        m->found = 1;
+        return;
+    }
+}
+
+static void read_counters(const void *attrs, int len, void *arg) {
+    odp_counters_t *c = arg;
+    const struct nlattr *table = nla_find(attrs, len, RDMA_NLDEV_ATTR_STAT_HWCOUNTERS);
+    const struct nlattr *e;
+    int rem;
+    
+    if (!table) return;
+    nla_for_each(e, nla_data(table), nla_plen(table), rem) {
+        const struct nlattr *name = nla_find(nla_data(e), nla_plen(e),
+                                             RDMA_NLDEV_ATTR_STAT_HWCOUNTER_ENTRY_NAME);
+        const struct nlattr *val = nla_find(nla_data(e), nla_plen(e),
+                                            RDMA_NLDEV_ATTR_STAT_HWCOUNTER_ENTRY_VALUE);
+        
+        if (!name || !val) continue;
+        if (strcmp(nla_data(name), "page_faults") == 0) {
+            c->page_faults += nla_u64(val);
+            c->found = 1;
+        } else if (strcmp(nla_data(name), "page_invalidations") == 0) {
+            c->page_invalidations += nla_u64(val);
+        }
+    }
+}
+
+// Add one MR's ODP counters to total; -1 if the kernel or driver doesn't
+// report them
+static int odp_mr_counters(uint32_t dev_index, struct ibv_mr *mr, odp_counters_t *total) {
+    odp_mr_match_t m = { .pid = getpid(), .length = mr->length, .lkey = mr->lkey };
+    odp_counters_t c = { 0 };
+    nl_req_t req;
+    
+    nldev_req_init(&req, RDMA_NLDEV_CMD_RES_MR_GET, 1);
+    nldev_put_u32(&req, RDMA_NLDEV_ATTR_DEV_INDEX, dev_index);
+    if (nldev_query(&req, match_mr, &m) < 0 || !m.found) return -1;
+    
+    nldev_req_init(&req, RDMA_NLDEV_CMD_STAT_GET, 0);
+    nldev_put_u32(&req, RDMA_NLDEV_ATTR_DEV_INDEX, dev_index);
+    nldev_put_u32(&req, RDMA_NLDEV_ATTR_STAT_RES, RDMA_NLDEV_ATTR_RES_MR);
+    nldev_put_u32(&req, RDMA_NLDEV_ATTR_RES_MRN, m.mrn);
+    if (nldev_query(&req, read_counters, &c) < 0 || !c.found) return -1;
+    
+    total->page_faults += c.page_faults;
+    total->page_invalidations += c.page_invalidations;
+    return 0;
+}
+
+void print_odp_stats(rdma_context_t *ctx) {
+    nl_dev_match_t dev = { .name = ctx->ib_dev_name };
+    odp_counters_t c = { 0 };
+    nl_req_t req;
+    
+    if (!ctx->odp_active) {
+        printf("   - ODP: off (%.3f ms pinned registration)\n", ctx->mr_reg_ms);
+        return;
+    }
+    
+    printf("   - ODP: %s MR, registered in %.3f ms\n",
+           odp_mode_str(ctx->odp_active), ctx->mr_reg_ms);
+    printf("   - ODP prefetches: %lu (%lu bytes)\n",
+           ctx->odp_prefetch_count, ctx->odp_prefetch_bytes);
+    
+    // The peer's accesses fault on remote_mr when it is separate
+    nldev_req_init(&req, RDMA_NLDEV_CMD_GET, 1);
+    if (nldev_query(&req, match_dev, &dev) < 0 || !dev.found ||
+        odp_mr_counters(dev.index, ctx->mr, &c) < 0 ||
+        (ctx->remote_mr && odp_mr_counters(dev.index, ctx->remote_mr, &c) < 0)) {
+        printf("   - NIC page faults: not reported by this device/kernel\n");
+        return;
+    }
+    printf("   - NIC page faults: %lu, invalidations: %lu\n",
+           c.page_faults, c.page_invalidations);
+}
+
+// Release the IB objects and the socket, leaving the buffer untouched
+void cleanup_ib_resources(rdma_context_t *ctx) {
     if (ctx->qp) ibv_destroy_qp(ctx->qp);
+    if (ctx->remote_mr) ibv_dereg_mr(ctx->remote_mr);
     if (ctx->mr) ibv_dereg_mr(ctx->mr);
     if (ctx->cq) ibv_destroy_cq(ctx->cq);
     if (ctx->pd) ibv_dealloc_pd(ctx->pd);
     if (ctx->ib_ctx) ibv_close_device(ctx->ib_ctx);
+    ctx->qp = NULL;
+    ctx->remote_mr = NULL;
+    ctx->mr = NULL;
+    ctx->cq = NULL;
+    ctx->pd = NULL;
+    ctx->ib_ctx = NULL;
+    
+    if (ctx->sock >= 0) {
+        close(ctx->sock);
+        ctx->sock = -1;
+    }
+}
+
+// Cleanup resources
+void cleanup_resources(rdma_context_t *ctx) {
+    cleanup_ib_resources(ctx);
     
     if (ctx->dmabuf_fd >= 0) {
         close(ctx->dmabuf_fd);
@@ -493,7 +1256,7 @@ void cleanup_resources(rdma_context_t *ctx) {
         if (ctx->host_device_va && ctx->gaudi_fd >= 0) {
             hlthunk_memory_unmap(ctx->gaudi_fd, ctx->host_device_va);
         }
-        free(ctx->buffer);
+        free_host_buffer(ctx);
     } else if (ctx->buffer) {
         // Unmap DMA-buf mmap
         munmap(ctx->buffer, ctx->buffer_size);
@@ -504,15 +1267,9 @@ void cleanup_resources(rdma_context_t *ctx) {
             hlthunk_memory_unmap(ctx->gaudi_fd, ctx->device_va);
         }
         hlthunk_device_memory_free(ctx->gaudi_fd, ctx->gaudi_handle);
-    } else if (ctx->buffer) {
-        free(ctx->buffer);
     }
     
     if (ctx->gaudi_fd >= 0) {
         hlthunk_close(ctx->gaudi_fd);
     }
-    
-    if (ctx->sock >= 0) {
-        close(ctx->sock);
-    }
 }
\ No newline at end of file
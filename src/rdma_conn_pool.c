@@ -0,0 +1,324 @@
+#include "rdma_conn_pool.h"
+#include <poll.h>
+
+static int read_full(int fd, void *buf, size_t len) {
+    size_t got = 0;
+    
+    while (got < len) {
+        ssize_t n = read(fd, (char *)buf + got, len - got);
+        if (n <= 0) return -1;
+        got += n;
+    }
+    return 0;
+}
+
+static int parse_peer_list(conn_pool_t *pool, const char *peer_list) {
+    char *copy = strdup(peer_list), *saveptr = NULL;
+    int count = 0;
+    
+    if (!copy) return -1;
+    for (char *tok = strtok_r(copy, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)) {
+        count++;
+    }
+    free(copy);
+    
+    if (count == 0 || count > POOL_MAX_PEERS) return -1;
+    pool->peers = calloc(count, sizeof(*pool->peers));
+    if (!pool->peers) return -1;
+    
+    copy = strdup(peer_list);
+    if (!copy) return -1;
+    count = 0;
+    for (char *tok = strtok_r(copy, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)) {
+        char *colon = strrchr(tok, ':');
+        if (!colon) {
+            free(copy);
+            return -1;
+        }
+        *colon = '\0';
+        snprintf(pool->peers[count].host, sizeof(pool->peers[count].host), "%s", tok);
+        pool->peers[count].port = atoi(colon + 1);
+        count++;
+    }
+    free(copy);
+    
+    pool->num_peers = count;
+    return 0;
+}
+
+static void conn_close(conn_pool_t *pool, int peer_id) {
+    pool_conn_t *c = pool->conns[peer_id];
+    
+    if (!c) return;
+    if (c->ctx.qp) ibv_destroy_qp(c->ctx.qp);
+    if (c->ctx.sock >= 0) close(c->ctx.sock);
+    free(c);
+    pool->conns[peer_id] = NULL;
+    pool->active--;
+}
+
+// Make room for one more QP by closing the least recently used connections.
+// Closing the socket tells the peer to drop its side as well.
+static void evict_lru(conn_pool_t *pool, int keep) {
+    while (pool->active >= pool->qp_budget) {
+        int victim = -1;
+        
+        for (int i = 0; i < pool->num_peers; i++) {
+            if (!pool->conns[i] || i == keep) continue;
+            if (victim < 0 || pool->conns[i]->last_used < pool->conns[victim]->last_used) {
+                victim = i;
+            }
+        }
+        if (victim < 0) return;
+        
+        conn_close(pool, victim);
+        pool->evictions++;
+    }
+}
+
+// Create the QP for a peer and run the QP handshake on an established
+// socket. Both ends run this; the socket is consumed either way.
+static int conn_establish(conn_pool_t *pool, int peer_id, int sock) {
+    pool_conn_t *c = calloc(1, sizeof(*c));
+    
+    if (!c) {
+        close(sock);
+        return -1;
+    }
+    
+    evict_lru(pool, peer_id);
+    
+    // Inherit device, PD, MR, CQ and path settings from the base context
+    c->ctx = *pool->base;
+    c->ctx.qp = NULL;
+    c->ctx.sock = sock;
+    c->peer_id = peer_id;
+    
+    if (create_qp(&c->ctx) || connect_qp(&c->ctx, NULL, 0)) {
+        fprintf(stderr, "Handshake with peer %d failed\n", peer_id);
+        if (c->ctx.qp) ibv_destroy_qp(c->ctx.qp);
+        close(sock);
+        free(c);
+        return -1;
+    }
+    
+    c->last_used = ++pool->tick;
+    pool->conns[peer_id] = c;
+    pool->active++;
+    if (pool->active > pool->peak_active) pool->peak_active = pool->active;
+    return 0;
+}
+
+// Handle one pending connection request. Returns 1 if a connection was
+// accepted, 0 if there was nothing to do or the request was refused.
+static int handle_accept(conn_pool_t *pool) {
+    uint32_t id;
+    char reply = 'Y';
+    int fd = accept(pool->listen_fd, NULL, NULL);
+    
+    if (fd < 0) return 0;
+    if (read_full(fd, &id, sizeof(id))) {
+        close(fd);
+        return 0;
+    }
+    id = ntohl(id);
+    
+    // Refuse unknown or already connected peers, and on glare (both sides
+    // connecting at once) let the request from the lower id win
+    if (id >= (uint32_t)pool->num_peers || (int)id == pool->my_id || pool->conns[id] ||
+        (pool->pending_peer == (int)id && pool->my_id < (int)id)) {
+        reply = 'N';
+    }
+    
+    if (write(fd, &reply, 1) != 1 || reply == 'N') {
+        close(fd);
+        return 0;
+    }
+    
+    if (conn_establish(pool, id, fd)) return 0;
+    pool->accepts++;
+    return 1;
+}
+
+static int conn_connect(conn_pool_t *pool, int peer_id) {
+    pool_peer_t *p = &pool->peers[peer_id];
+    double deadline = now_ms() + POOL_CONNECT_TIMEOUT_MS;
+    
+    while (!pool->conns[peer_id] && now_ms() < deadline) {
+        uint32_t id = htonl(pool->my_id);
+        char reply = 'N';
+        int fd = sock_connect(p->host, p->port);
+        
+        if (fd < 0 || write(fd, &id, sizeof(id)) != sizeof(id)) {
+            if (fd >= 0) close(fd);
+            conn_pool_progress(pool);
+            usleep(1000);
+            continue;
+        }
+        
+        // Wait for the verdict, serving incoming requests meanwhile so two
+        // peers connecting to each other can't deadlock
+        pool->pending_peer = peer_id;
+        while (!pool->conns[peer_id] && now_ms() < deadline) {
+            struct pollfd pfds[2] = {
+                { .fd = fd, .events = POLLIN },
+                { .fd = pool->listen_fd, .events = POLLIN }
+            };
+            
+            if (poll(pfds, 2, 10) < 0) break;
+            if (pfds[1].revents & POLLIN) handle_accept(pool);
+            if (pfds[0].revents) {
+                if (read(fd, &reply, 1) != 1) reply = 'N';
+                break;
+            }
+        }
+        pool->pending_peer = -1;
+        
+        if (pool->conns[peer_id]) {
+            // The peer's own request won the race
+            close(fd);
+            break;
+        }
+        if (reply == 'Y') {
+            if (conn_establish(pool, peer_id, fd) == 0) pool->connects++;
+            break;
+        }
+        close(fd);
+        usleep(1000);
+    }
+    
+    return pool->conns[peer_id] ? 0 : -1;
+}
+
+// A readable handshake socket with nothing to read means the peer closed it
+static int peer_closed(int sock) {
+    struct pollfd pfd = { .fd = sock, .events = POLLIN };
+    char b;
+    
+    if (poll(&pfd, 1, 0) <= 0) return 0;
+    return recv(sock, &b, 1, MSG_PEEK | MSG_DONTWAIT) == 0 || (pfd.revents & (POLLHUP | POLLERR));
+}
+
+int conn_pool_init(conn_pool_t *pool, rdma_context_t *base, int my_id,
+                   const char *peer_list, int qp_budget) {
+    memset(pool, 0, sizeof(*pool));
+    pool->base = base;
+    pool->my_id = my_id;
+    pool->qp_budget = qp_budget > 0 ? qp_budget : 1;
+    pool->pending_peer = -1;
+    pool->listen_fd = -1;
+    
+    if (parse_peer_list(pool, peer_list) || my_id < 0 || my_id >= pool->num_peers) {
+        fprintf(stderr, "Invalid peer list or id\n");
+        free(pool->peers);
+        return -1;
+    }
+    
+    pool->conns = calloc(pool->num_peers, sizeof(*pool->conns));
+    if (!pool->conns) {
+        free(pool->peers);
+        return -1;
+    }
+    
+    pool->listen_fd = sock_listen(pool->peers[my_id].port);
+    if (pool->listen_fd < 0) {
+        fprintf(stderr, "Failed to listen on port %d\n", pool->peers[my_id].port);
+        conn_pool_destroy(pool);
+        return -1;
+    }
+    fcntl(pool->listen_fd, F_SETFL, fcntl(pool->listen_fd, F_GETFL) | O_NONBLOCK);
+    
+    // Every connection completes into the shared CQ
+    int cqe = pool->qp_budget * RDMA_MAX_WR;
+    if (cqe > base->dev_attr.max_cqe) cqe = base->dev_attr.max_cqe;
+    if (cqe > RDMA_CQ_SIZE && ibv_resize_cq(base->cq, cqe)) {
+        printf("Could not grow the shared CQ to %d entries\n", cqe);
+    }
+    
+    printf("Connection pool: peer %d of %d, QP budget %d\n",
+           my_id, pool->num_peers, pool->qp_budget);
+    return 0;
+}
+
+rdma_context_t *conn_pool_get(conn_pool_t *pool, int peer_id) {
+    if (peer_id < 0 || peer_id >= pool->num_peers || peer_id == pool->my_id) {
+        return NULL;
+    }
+    
+    // Drop the connection if the peer evicted it since we last used it
+    if (pool->conns[peer_id] && peer_closed(pool->conns[peer_id]->ctx.sock)) {
+        conn_close(pool, peer_id);
+    }
+    
+    if (!pool->conns[peer_id] && conn_connect(pool, peer_id)) {
+        fprintf(stderr, "Failed to connect to peer %d\n", peer_id);
+        return NULL;
+    }
+    
+    pool->conns[peer_id]->last_used = ++pool->tick;
+    return &pool->conns[peer_id]->ctx;
+}
+
+int conn_pool_progress(conn_pool_t *pool) {
+    int accepted = 0;
+    
+    while (handle_accept(pool) > 0) accepted++;
+    
+    for (int i = 0; i < pool->num_peers; i++) {
+        if (pool->conns[i] && peer_closed(pool->conns[i]->ctx.sock)) {
+            conn_close(pool, i);
+        }
+    }
+    return accepted;
+}
+
+int conn_pool_write(conn_pool_t *pool, int peer_id, uint64_t local_off,
+                    uint64_t remote_off, uint32_t len) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        rdma_context_t *c = conn_pool_get(pool, peer_id);
+        struct ibv_wc wc;
+        int ne;
+        
+        if (!c) return -1;
+        if (post_rdma_range(c, IBV_WR_RDMA_WRITE, local_off, remote_off, len, peer_id)) {
+            conn_close(pool, peer_id);
+            continue;
+        }
+        
+        // RC retries guarantee a completion, success or error. The CQ is
+        // shared by every pooled QP, so skip anything that isn't ours
+        // (e.g. flushes from a QP torn down meanwhile).
+        do {
+            while ((ne = ibv_poll_cq(pool->base->cq, 1, &wc)) == 0)
+                ;
+            if (ne < 0) {
+                fprintf(stderr, "Poll CQ failed\n");
+                return -1;
+            }
+        } while (wc.qp_num != c->qp->qp_num || wc.wr_id != (uint64_t)peer_id);
+        if (wc.status == IBV_WC_SUCCESS) return 0;
+        
+        fprintf(stderr, "Write to peer %d failed (%s), reconnecting\n",
+                peer_id, ibv_wc_status_str(wc.status));
+        conn_close(pool, peer_id);
+    }
+    return -1;
+}
+
+void conn_pool_print(conn_pool_t *pool) {
+    printf("   - Peers: %d, QP budget: %d\n", pool->num_peers, pool->qp_budget);
+    printf("   - Active QPs: %d (peak %d)\n", pool->active, pool->peak_active);
+    printf("   - Connects: %lu, accepts: %lu, evictions: %lu\n",
+           pool->connects, pool->accepts, pool->evictions);
+}
+
+void conn_pool_destroy(conn_pool_t *pool) {
+    if (pool->conns) {
+        for (int i = 0; i < pool->num_peers; i++) conn_close(pool, i);
+        free(pool->conns);
+    }
+    if (pool->listen_fd >= 0) close(pool->listen_fd);
+    free(pool->peers);
+    memset(pool, 0, sizeof(*pool));
+    pool->listen_fd = -1;
+}
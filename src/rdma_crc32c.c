@@ -0,0 +1,265 @@
+#include "rdma_crc32c.h"
+#include <immintrin.h>
+#include <pthread.h>
+#include <string.h>
+
+#define CRC32C_POLY 0x82f63b78  // Castagnoli polynomial, bit-reflected
+
+// Block sizes for the three interleaved SSE4.2 streams. The crc of each
+// block is carried across the blocks after it by an "append n zero bytes"
+// operator applied through tables.
+#define CRC_LONG 8192
+#define CRC_SHORT 256
+
+#define CRC_TARGET_SSE42 __attribute__((target("sse4.2")))
+#define CRC_TARGET_AVX512 __attribute__((target("avx512f,vpclmulqdq,pclmul,sse4.2")))
+
+static uint32_t crc_table[8][256];
+static uint32_t crc_long[4][256], crc_short[4][256];
+static crc32c_fn crc_impls[CRC32C_NUM_IMPLS];
+static const char *crc_names[CRC32C_NUM_IMPLS] = {
+    "slicing-by-8", "sse4.2", "avx512-vpclmulqdq"
+};
+static int crc_best;
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len) {
+    const unsigned char *p = buf;
+    
+    crc = ~crc;
+    while (len && ((uintptr_t)p & 7)) {
+        crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        w ^= crc;
+        crc = crc_table[7][w & 0xff] ^ crc_table[6][(w >> 8) & 0xff] ^
+              crc_table[5][(w >> 16) & 0xff] ^ crc_table[4][(w >> 24) & 0xff] ^
+              crc_table[3][(w >> 32) & 0xff] ^ crc_table[2][(w >> 40) & 0xff] ^
+              crc_table[1][(w >> 48) & 0xff] ^ crc_table[0][w >> 56];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+// GF(2) 32x32 matrix times vector; mat[n] is the image of bit n
+static uint32_t gf2_times(const uint32_t *mat, uint32_t vec) {
+    uint32_t sum = 0;
+    
+    for (; vec; vec >>= 1, mat++) {
+        if (vec & 1) sum ^= *mat;
+    }
+    return sum;
+}
+
+static void gf2_square(uint32_t *square, const uint32_t *mat) {
+    for (int n = 0; n < 32; n++) square[n] = gf2_times(mat, mat[n]);
+}
+
+// Tables that take a crc to the crc of the same data followed by len zero
+// bytes (len a power of two)
+static void build_zeros_table(uint32_t zeros[4][256], size_t len) {
+    uint32_t op[32], sq[32];
+    
+    // One zero bit, then square up to one byte and on to len bytes
+    op[0] = CRC32C_POLY;
+    for (int n = 1; n < 32; n++) op[n] = 1u << (n - 1);
+    for (size_t bits = 1; bits < len * 8; bits <<= 1) {
+        gf2_square(sq, op);
+        memcpy(op, sq, sizeof(op));
+    }
+    
+    for (uint32_t n = 0; n < 256; n++) {
+        for (int b = 0; b < 4; b++) zeros[b][n] = gf2_times(op, n << (8 * b));
+    }
+}
+
+static uint32_t crc_shift(uint32_t zeros[4][256], uint32_t crc) {
+    return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^
+           zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+
+// Raw (un-inverted) crc32 over three streams at a time: the instruction has
+// a latency of three cycles but issues every cycle
+CRC_TARGET_SSE42
+static uint32_t crc_sse42_raw(uint32_t crc, const unsigned char *p, size_t len) {
+    uint64_t crc0 = crc, crc1, crc2;
+    
+    while (len && ((uintptr_t)p & 7)) {
+        crc0 = _mm_crc32_u8(crc0, *p++);
+        len--;
+    }
+    
+    while (len >= 3 * CRC_LONG) {
+        const unsigned char *end = p + CRC_LONG;
+        crc1 = crc2 = 0;
+        do {
+            crc0 = _mm_crc32_u64(crc0, *(const uint64_t *)p);
+            crc1 = _mm_crc32_u64(crc1, *(const uint64_t *)(p + CRC_LONG));
+            crc2 = _mm_crc32_u64(crc2, *(const uint64_t *)(p + 2 * CRC_LONG));
+            p += 8;
+        } while (p < end);
+        crc0 = crc_shift(crc_long, crc0) ^ crc1;
+        crc0 = crc_shift(crc_long, crc0) ^ crc2;
+        p += 2 * CRC_LONG;
+        len -= 3 * CRC_LONG;
+    }
+    
+    while (len >= 3 * CRC_SHORT) {
+        const unsigned char *end = p + CRC_SHORT;
+        crc1 = crc2 = 0;
+        do {
+            crc0 = _mm_crc32_u64(crc0, *(const uint64_t *)p);
+            crc1 = _mm_crc32_u64(crc1, *(const uint64_t *)(p + CRC_SHORT));
+            crc2 = _mm_crc32_u64(crc2, *(const uint64_t *)(p + 2 * CRC_SHORT));
+            p += 8;
+        } while (p < end);
+        crc0 = crc_shift(crc_short, crc0) ^ crc1;
+        crc0 = crc_shift(crc_short, crc0) ^ crc2;
+        p += 2 * CRC_SHORT;
+        len -= 3 * CRC_SHORT;
+    }
+    
+    while (len >= 8) {
+        crc0 = _mm_crc32_u64(crc0, *(const uint64_t *)p);
+        p += 8;
+        len -= 8;
+    }
+    while (len--) crc0 = _mm_crc32_u8(crc0, *p++);
+    return crc0;
+}
+
+CRC_TARGET_SSE42
+static uint32_t crc32c_sse42(uint32_t crc, const void *buf, size_t len) {
+    return ~crc_sse42_raw(~crc, buf, len);
+}
+
+// Fold constants for a 128-bit lane moved D bits forward: the low qword
+// (the higher-order half, bit-reflected) is multiplied by x^(D+31) mod P and
+// the high qword by x^(D-33) mod P, both bit-reflected. The exponents absorb
+// the shift a carry-less multiply of reflected operands introduces.
+#define FOLD_128   0xf20c0dfeULL, 0x493c7d27ULL
+#define FOLD_512   0x740eef02ULL, 0x9e4addf8ULL
+#define FOLD_2048  0xdcb17aa4ULL, 0xb9e02b86ULL
+
+CRC_TARGET_AVX512
+static inline __m512i fold_512(__m512i acc, __m512i k, __m512i data) {
+    __m512i lo = _mm512_clmulepi64_epi128(acc, k, 0x00);
+    __m512i hi = _mm512_clmulepi64_epi128(acc, k, 0x11);
+    return _mm512_ternarylogic_epi64(lo, hi, data, 0x96);  // lo ^ hi ^ data
+}
+
+CRC_TARGET_AVX512
+static inline __m128i fold_128(__m128i acc, __m128i k, __m128i data) {
+    __m128i lo = _mm_clmulepi64_si128(acc, k, 0x00);
+    __m128i hi = _mm_clmulepi64_si128(acc, k, 0x11);
+    return _mm_xor_si128(_mm_xor_si128(lo, hi), data);
+}
+
+CRC_TARGET_AVX512
+static inline __m512i fold_const(uint64_t k_lo, uint64_t k_hi) {
+    return _mm512_broadcast_i32x4(_mm_set_epi64x(k_hi, k_lo));
+}
+
+// Fold 256 bytes per iteration through four accumulators of four 128-bit
+// lanes each, collapse them to 128 bits, and let the crc32 instruction do
+// the final reduction modulo P
+CRC_TARGET_AVX512
+static uint32_t crc32c_avx512(uint32_t crc, const void *buf, size_t len) {
+    const unsigned char *p = buf;
+    
+    if (len < 256) return ~crc_sse42_raw(~crc, p, len);
+    
+    __m512i x0 = _mm512_loadu_si512(p), x1 = _mm512_loadu_si512(p + 64);
+    __m512i x2 = _mm512_loadu_si512(p + 128), x3 = _mm512_loadu_si512(p + 192);
+    __m512i k = fold_const(FOLD_2048);
+    
+    // The incoming crc stands in for the first 32 bits of the data
+    x0 = _mm512_xor_si512(x0, _mm512_maskz_set1_epi32(1, ~crc));
+    p += 256;
+    len -= 256;
+    
+    while (len >= 256) {
+        x0 = fold_512(x0, k, _mm512_loadu_si512(p));
+        x1 = fold_512(x1, k, _mm512_loadu_si512(p + 64));
+        x2 = fold_512(x2, k, _mm512_loadu_si512(p + 128));
+        x3 = fold_512(x3, k, _mm512_loadu_si512(p + 192));
+        p += 256;
+        len -= 256;
+    }
+    
+    k = fold_const(FOLD_512);
+    x0 = fold_512(x0, k, x1);
+    x0 = fold_512(x0, k, x2);
+    x0 = fold_512(x0, k, x3);
+    while (len >= 64) {
+        x0 = fold_512(x0, k, _mm512_loadu_si512(p));
+        p += 64;
+        len -= 64;
+    }
+    
+    __m128i k128 = _mm512_castsi512_si128(fold_const(FOLD_128));
+    __m128i a = _mm512_extracti32x4_epi32(x0, 0);
+    a = fold_128(a, k128, _mm512_extracti32x4_epi32(x0, 1));
+    a = fold_128(a, k128, _mm512_extracti32x4_epi32(x0, 2));
+    a = fold_128(a, k128, _mm512_extracti32x4_epi32(x0, 3));
+    while (len >= 16) {
+        a = fold_128(a, k128, _mm_loadu_si128((const __m128i *)p));
+        p += 16;
+        len -= 16;
+    }
+    
+    uint64_t c = _mm_crc32_u64(0, _mm_cvtsi128_si64(a));
+    c = _mm_crc32_u64(c, _mm_extract_epi64(a, 1));
+    return ~crc_sse42_raw(c, p, len);
+}
+
+static void crc32c_init(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int b = 0; b < 8; b++) c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        crc_table[0][n] = c;
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        for (int t = 1; t < 8; t++) {
+            uint32_t c = crc_table[t - 1][n];
+            crc_table[t][n] = crc_table[0][c & 0xff] ^ (c >> 8);
+        }
+    }
+    build_zeros_table(crc_long, CRC_LONG);
+    build_zeros_table(crc_short, CRC_SHORT);
+    
+    crc_impls[0] = crc32c_sw;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc_impls[1] = crc32c_sse42;
+        crc_best = 1;
+        
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("pclmul") &&
+            __builtin_cpu_supports("vpclmulqdq")) {
+            crc_impls[2] = crc32c_avx512;
+            crc_best = 2;
+        }
+    }
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len) {
+    pthread_once(&crc_once, crc32c_init);
+    return crc_impls[crc_best](crc, buf, len);
+}
+
+const char *crc32c_impl(void) {
+    pthread_once(&crc_once, crc32c_init);
+    return crc_names[crc_best];
+}
+
+crc32c_fn crc32c_get_impl(int i, const char **name) {
+    pthread_once(&crc_once, crc32c_init);
+    if (i < 0 || i >= CRC32C_NUM_IMPLS) return NULL;
+    if (name) *name = crc_names[i];
+    return crc_impls[i];
+}
@@ -0,0 +1,70 @@
+#include "rdma_common.h"
+#include "rdma_crc32c.h"
+
+// Single-threaded CRC32C throughput per implementation and buffer size,
+// i.e. what one core can checksum next to the transfer engine
+int main(int argc, char *argv[]) {
+    const size_t sizes[] = { 4096, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024 };
+    const int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    double min_ms = 200;
+    unsigned char *buf;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            min_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-h") == 0) {
+            printf("Usage: %s [-t ms_per_case]\n", argv[0]);
+            return 0;
+        }
+    }
+    
+    buf = aligned_alloc(4096, sizes[num_sizes - 1]);
+    if (!buf) {
+        fprintf(stderr, "Failed to allocate buffer\n");
+        return 1;
+    }
+    for (size_t i = 0; i < sizes[num_sizes - 1]; i++) buf[i] = i * 2654435761u >> 24;
+    
+    printf("CRC32C throughput, one core (dispatch: %s)\n", crc32c_impl());
+    printf("%-20s", "implementation");
+    for (int s = 0; s < num_sizes; s++) printf(" %10zu KB", sizes[s] / 1024);
+    printf("\n");
+    
+    uint32_t ref[num_sizes];
+    for (int s = 0; s < num_sizes; s++) ref[s] = crc32c_get_impl(0, NULL)(0, buf, sizes[s]);
+    
+    for (int i = 0; i < CRC32C_NUM_IMPLS; i++) {
+        const char *name;
+        crc32c_fn fn = crc32c_get_impl(i, &name);
+        
+        printf("%-20s", name);
+        if (!fn) {
+            printf(" (not supported by this CPU)\n");
+            continue;
+        }
+        
+        for (int s = 0; s < num_sizes; s++) {
+            uint64_t bytes = 0;
+            uint32_t crc = 0;
+            double start = now_ms(), elapsed;
+            
+            do {
+                for (int r = 0; r < 16; r++) {
+                    crc = fn(0, buf, sizes[s]);
+                    bytes += sizes[s];
+                }
+                elapsed = now_ms() - start;
+            } while (elapsed < min_ms);
+            
+            if (crc != ref[s]) {
+                printf("   MISMATCH");
+                continue;
+            }
+            printf(" %8.2f GB/s", bytes / (elapsed * 1e6));
+        }
+        printf("\n");
+    }
+    
+    free(buf);
+    return 0;
+}
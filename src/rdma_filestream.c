@@ -0,0 +1,288 @@
+#include "rdma_filestream.h"
+#include <liburing.h>
+#include <poll.h>
+#include <sys/stat.h>
+
+enum slot_state {
+    SLOT_FREE,
+    SLOT_DISK,    // Disk I/O in flight
+    SLOT_LOADED,  // Read from disk, waiting for a remote slot
+    SLOT_WIRE     // RDMA Write in flight
+};
+
+static void *slot_ptr(rdma_context_t *ctx, fstream_t *fs, int slot) {
+    return (char *)ctx->buffer + (size_t)slot * fs->chunk;
+}
+
+// Prefer O_DIRECT; fall back to buffered I/O where the filesystem refuses it
+static int open_file(const char *path, int flags, fstream_t *fs) {
+    int fd = open(path, flags | O_DIRECT, 0644);
+    
+    fs->direct = fd >= 0;
+    if (fd < 0 && errno == EINVAL) {
+        printf("O_DIRECT not supported for %s, using buffered I/O\n", path);
+        fd = open(path, flags, 0644);
+    }
+    if (fd < 0) fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+    return fd;
+}
+
+static int sock_readable(int sock) {
+    struct pollfd pfd = { .fd = sock, .events = POLLIN };
+    return poll(&pfd, 1, 0) > 0;
+}
+
+int fstream_send(rdma_context_t *ctx, const char *path, fstream_t *fs) {
+    int state[FSTREAM_MAX_SLOTS], remote_free[FSTREAM_MAX_SLOTS] = {0};
+    uint32_t chunk_of[FSTREAM_MAX_SLOTS], len_of[FSTREAM_MAX_SLOTS];
+    struct ibv_wc wc[FSTREAM_MAX_SLOTS];
+    struct io_uring ring;
+    struct io_uring_cqe *cqe;
+    struct stat st;
+    uint64_t next = 0, shipped = 0, value;
+    uint32_t msg_type;
+    int fd, ret = -1;
+    
+    if (!ctx->buffer) {
+        fprintf(stderr, "File streaming needs a CPU-visible buffer\n");
+        return -1;
+    }
+    
+    // Slot geometry: as many aligned chunks as fit, at least two
+    if (!fs->chunk) fs->chunk = FSTREAM_CHUNK_SIZE;
+    if (fs->chunk > ctx->buffer_size / 2) fs->chunk = ctx->buffer_size / 2;
+    fs->chunk &= ~(size_t)(FSTREAM_ALIGN - 1);
+    fs->slots = ctx->buffer_size / fs->chunk;
+    if (fs->slots > FSTREAM_MAX_SLOTS) fs->slots = FSTREAM_MAX_SLOTS;
+    if (fs->chunk == 0 || fs->slots < 2) {
+        fprintf(stderr, "Buffer too small for file streaming\n");
+        return -1;
+    }
+    
+    fd = open_file(path, O_RDONLY, fs);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st)) {
+        close(fd);
+        return -1;
+    }
+    fs->size = st.st_size;
+    fs->chunks = (fs->size + fs->chunk - 1) / fs->chunk;
+    
+    if (io_uring_queue_init(fs->slots, &ring, 0) < 0) {
+        fprintf(stderr, "Failed to set up io_uring\n");
+        close(fd);
+        return -1;
+    }
+    
+    if (send_ctrl(ctx, CTRL_FILE, fs->size) ||
+        send_ctrl(ctx, CTRL_CHUNK, (uint64_t)fs->chunk << 32 | fs->slots)) {
+        goto out;
+    }
+    
+    for (int s = 0; s < fs->slots; s++) state[s] = SLOT_FREE;
+    double start = now_ms();
+    
+    while (shipped < fs->chunks) {
+        int submitted = 0;
+        
+        // Disk: read ahead into free slots, in chunk order
+        while (next < fs->chunks && state[next % fs->slots] == SLOT_FREE) {
+            struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+            int s = next % fs->slots;
+            
+            if (!sqe) break;
+            io_uring_prep_read(sqe, fd, slot_ptr(ctx, fs, s), fs->chunk, next * fs->chunk);
+            io_uring_sqe_set_data64(sqe, next);
+            state[s] = SLOT_DISK;
+            chunk_of[s] = next++;
+            submitted++;
+        }
+        if (submitted) io_uring_submit(&ring);
+        
+        while (io_uring_peek_cqe(&ring, &cqe) == 0) {
+            uint64_t c = io_uring_cqe_get_data64(cqe);
+            int res = cqe->res;
+            
+            io_uring_cqe_seen(&ring, cqe);
+            if (res < 0 || (res < (int)fs->chunk && c != fs->chunks - 1)) {
+                fprintf(stderr, "Read of chunk %lu failed: %s\n", c,
+                        res < 0 ? strerror(-res) : "short read");
+                goto out;
+            }
+            len_of[c % fs->slots] = res;
+            state[c % fs->slots] = SLOT_LOADED;
+        }
+        
+        // Wire: ship every loaded chunk whose remote slot is free
+        for (int s = 0; s < fs->slots; s++) {
+            if (state[s] != SLOT_LOADED || !remote_free[s]) continue;
+            uint64_t off = (uint64_t)s * fs->chunk;
+            if (post_write_imm(ctx, off, off, len_of[s], chunk_of[s], s)) {
+                fprintf(stderr, "Failed to post chunk %u\n", chunk_of[s]);
+                goto out;
+            }
+            state[s] = SLOT_WIRE;
+            remote_free[s] = 0;
+        }
+        
+        int ne = ibv_poll_cq(ctx->cq, fs->slots, wc);
+        if (ne < 0) {
+            fprintf(stderr, "Poll CQ failed\n");
+            goto out;
+        }
+        for (int i = 0; i < ne; i++) {
+            if (wc[i].status != IBV_WC_SUCCESS) {
+                fprintf(stderr, "Chunk write failed: %s\n", ibv_wc_status_str(wc[i].status));
+                goto out;
+            }
+            state[wc[i].wr_id] = SLOT_FREE;
+            shipped++;
+        }
+        
+        // Credits: the receiver has flushed a slot to disk
+        while (sock_readable(ctx->sock)) {
+            if (recv_ctrl(ctx, &msg_type, &value)) goto out;
+            if (msg_type == CTRL_CREDIT && value < (uint64_t)fs->slots) remote_free[value] = 1;
+        }
+    }
+    
+    // Done once the receiver reports the file is on its disk; any other
+    // size means it could not be made durable
+    do {
+        if (recv_ctrl(ctx, &msg_type, &value)) goto out;
+    } while (msg_type != CTRL_DONE);
+    if (value != fs->size) {
+        fprintf(stderr, "Receiver failed to persist %s\n", path);
+        goto out;
+    }
+    
+    fs->elapsed_ms = now_ms() - start;
+    ret = 0;
+    
+out:
+    io_uring_queue_exit(&ring);
+    close(fd);
+    return ret;
+}
+
+int fstream_recv(rdma_context_t *ctx, const char *path, fstream_t *fs) {
+    uint32_t len_of[FSTREAM_MAX_SLOTS];
+    struct ibv_wc wc[FSTREAM_MAX_SLOTS];
+    struct io_uring ring;
+    struct io_uring_cqe *cqe;
+    uint64_t written = 0, value;
+    uint32_t msg_type;
+    int fd, ret = -1;
+    
+    if (!ctx->buffer) {
+        fprintf(stderr, "File streaming needs a CPU-visible buffer\n");
+        return -1;
+    }
+    
+    if (recv_ctrl(ctx, &msg_type, &fs->size) || msg_type != CTRL_FILE ||
+        recv_ctrl(ctx, &msg_type, &value) || msg_type != CTRL_CHUNK) {
+        fprintf(stderr, "Expected a file stream header\n");
+        return -1;
+    }
+    fs->chunk = value >> 32;
+    fs->slots = value & 0xffffffff;
+    fs->chunks = fs->chunk ? (fs->size + fs->chunk - 1) / fs->chunk : 0;
+    if (fs->slots < 1 || fs->slots > FSTREAM_MAX_SLOTS ||
+        fs->chunk * fs->slots > ctx->buffer_size) {
+        fprintf(stderr, "Sender's %d x %zu byte slots don't fit our buffer\n", fs->slots, fs->chunk);
+        return -1;
+    }
+    
+    fd = open_file(path, O_WRONLY | O_CREAT | O_TRUNC, fs);
+    if (fd < 0) return -1;
+    
+    if (io_uring_queue_init(fs->slots, &ring, 0) < 0) {
+        fprintf(stderr, "Failed to set up io_uring\n");
+        close(fd);
+        return -1;
+    }
+    
+    // One receive per slot, then hand every slot to the sender
+    for (int s = 0; s < fs->slots; s++) {
+        if (post_imm_receive(ctx) || send_ctrl(ctx, CTRL_CREDIT, s)) {
+            fprintf(stderr, "Failed to set up receive slots\n");
+            goto out;
+        }
+    }
+    
+    double start = now_ms();
+    
+    while (written < fs->chunks) {
+        int ne = ibv_poll_cq(ctx->cq, fs->slots, wc);
+        
+        if (ne < 0) {
+            fprintf(stderr, "Poll CQ failed\n");
+            goto out;
+        }
+        for (int i = 0; i < ne; i++) {
+            if (wc[i].status != IBV_WC_SUCCESS || wc[i].opcode != IBV_WC_RECV_RDMA_WITH_IMM) {
+                fprintf(stderr, "Chunk receive failed: %s\n", ibv_wc_status_str(wc[i].status));
+                goto out;
+            }
+            
+            uint32_t c = ntohl(wc[i].imm_data);
+            int s = c % fs->slots;
+            struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+            
+            // O_DIRECT writes whole blocks; the tail is trimmed at the end
+            len_of[s] = wc[i].byte_len;
+            uint32_t len = fs->direct ? (len_of[s] + FSTREAM_ALIGN - 1) & ~(FSTREAM_ALIGN - 1) : len_of[s];
+            
+            if (!sqe || post_imm_receive(ctx)) {
+                fprintf(stderr, "Out of submission or receive entries\n");
+                goto out;
+            }
+            io_uring_prep_write(sqe, fd, slot_ptr(ctx, fs, s), len, (uint64_t)c * fs->chunk);
+            io_uring_sqe_set_data64(sqe, c);
+            io_uring_submit(&ring);
+        }
+        
+        while (io_uring_peek_cqe(&ring, &cqe) == 0) {
+            uint64_t c = io_uring_cqe_get_data64(cqe);
+            int res = cqe->res;
+            
+            io_uring_cqe_seen(&ring, cqe);
+            if (res < 0) {
+                fprintf(stderr, "Write of chunk %lu failed: %s\n", c, strerror(-res));
+                goto out;
+            }
+            if (send_ctrl(ctx, CTRL_CREDIT, c % fs->slots)) goto out;
+            written++;
+        }
+    }
+    
+    // The size change is metadata even under O_DIRECT, and the buffered
+    // fallback may still hold data, so flush both before reporting DONE
+    if (ftruncate(fd, fs->size)) {
+        fprintf(stderr, "Failed to truncate %s: %s\n", path, strerror(errno));
+        send_ctrl(ctx, CTRL_DONE, UINT64_MAX);
+        goto out;
+    }
+    if (fdatasync(fd)) {
+        fprintf(stderr, "Failed to sync %s: %s\n", path, strerror(errno));
+        send_ctrl(ctx, CTRL_DONE, UINT64_MAX);
+        goto out;
+    }
+    
+    fs->elapsed_ms = now_ms() - start;
+    ret = send_ctrl(ctx, CTRL_DONE, fs->size);
+    
+out:
+    io_uring_queue_exit(&ring);
+    close(fd);
+    return ret;
+}
+
+void print_fstream_stats(const char *label, const fstream_t *fs) {
+    double secs = fs->elapsed_ms / 1000.0;
+    
+    printf("   - %s: %lu bytes in %lu chunk(s) of %zu KB over %d slots%s\n", label,
+           fs->size, fs->chunks, fs->chunk / 1024, fs->slots, fs->direct ? ", O_DIRECT" : "");
+    printf("   - %s: %.3f ms, %.2f MB/s\n", label, fs->elapsed_ms,
+           secs > 0 ? fs->size / secs / 1e6 : 0.0);
+}
@@ -0,0 +1,425 @@
+#include "rdma_kernels.h"
+#include <immintrin.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+// AVX-512 implies FMA, and GCC would contract y + a * x into one there;
+// keep every path to a separate multiply and add so they round alike
+#pragma GCC optimize("fp-contract=off")
+
+enum { KERN_OP_SUM, KERN_OP_SCALE, KERN_OP_AXPY, KERN_NUM_OPS };
+#define KERN_NUM_TYPES 3
+
+#define KERN_TARGET_AVX2 __attribute__((target("avx2")))
+#define KERN_TARGET_AVX512 __attribute__((target("avx512f")))
+
+typedef void (*kern_fn)(void *y, const void *x, size_t n, float alpha);
+
+static kern_fn kern_table[KERN_NUM_OPS][KERN_NUM_TYPES];
+static const char *kern_isa_name = "scalar";
+static int kern_threads = 1;
+static pthread_once_t kern_once = PTHREAD_ONCE_INIT;
+
+size_t kern_type_size(kern_dtype_t type) {
+    return type == KERN_BF16 ? 2 : 4;
+}
+
+static inline float bf16_to_f32(uint16_t h) {
+    uint32_t u = (uint32_t)h << 16;
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+// Round to nearest even; NaNs become the canonical quiet NaN
+static inline uint16_t f32_to_bf16(float f) {
+    uint32_t u;
+    
+    if (f != f) return 0x7fc0;
+    memcpy(&u, &f, sizeof(u));
+    return (u + 0x7fff + ((u >> 16) & 1)) >> 16;
+}
+
+// Integers wrap, so do the arithmetic unsigned
+static inline uint32_t op_u32(int op, uint32_t y, uint32_t x, uint32_t a) {
+    switch (op) {
+    case KERN_OP_SUM:   return y + x;
+    case KERN_OP_SCALE: return y * a;
+    default:            return y + a * x;
+    }
+}
+
+static inline float op_f32(int op, float y, float x, float a) {
+    switch (op) {
+    case KERN_OP_SUM:   return y + x;
+    case KERN_OP_SCALE: return y * a;
+    default:            return y + a * x;
+    }
+}
+
+// x is NULL for KERN_OP_SCALE
+static inline void scalar_kernel(int op, kern_dtype_t type, void *yv, const void *xv,
+                                 size_t n, float alpha) {
+    if (type == KERN_INT32) {
+        int32_t *y = yv;
+        const int32_t *x = xv;
+        uint32_t a = (uint32_t)(int32_t)alpha;
+        for (size_t i = 0; i < n; i++) {
+            y[i] = (int32_t)op_u32(op, y[i], op == KERN_OP_SCALE ? 0 : x[i], a);
+        }
+    } else if (type == KERN_FP32) {
+        float *y = yv;
+        const float *x = xv;
+        for (size_t i = 0; i < n; i++) {
+            y[i] = op_f32(op, y[i], op == KERN_OP_SCALE ? 0 : x[i], alpha);
+        }
+    } else {
+        uint16_t *y = yv;
+        const uint16_t *x = xv;
+        for (size_t i = 0; i < n; i++) {
+            float xf = op == KERN_OP_SCALE ? 0 : bf16_to_f32(x[i]);
+            y[i] = f32_to_bf16(op_f32(op, bf16_to_f32(y[i]), xf, alpha));
+        }
+    }
+}
+
+// Remainder after the vector loop
+static inline void scalar_tail(int op, kern_dtype_t type, void *y, const void *x,
+                               size_t done, size_t n, float alpha) {
+    size_t off = done * kern_type_size(type);
+    
+    scalar_kernel(op, type, (char *)y + off, x ? (const char *)x + off : NULL,
+                  n - done, alpha);
+}
+
+// AVX2: eight lanes
+KERN_TARGET_AVX2
+static inline __m256 bf16x8_load(const uint16_t *p) {
+    __m256i w = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)p));
+    return _mm256_castsi256_ps(_mm256_slli_epi32(w, 16));
+}
+
+KERN_TARGET_AVX2
+static inline void bf16x8_store(uint16_t *p, __m256 v) {
+    __m256i u = _mm256_castps_si256(v);
+    __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+    __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(u, 16), _mm256_set1_epi32(1));
+    
+    u = _mm256_add_epi32(u, _mm256_add_epi32(lsb, _mm256_set1_epi32(0x7fff)));
+    u = _mm256_blendv_epi8(u, _mm256_set1_epi32(0x7fc00000), nan);
+    u = _mm256_srli_epi32(u, 16);
+    _mm_storeu_si128((__m128i *)p, _mm_packus_epi32(_mm256_castsi256_si128(u),
+                                                    _mm256_extracti128_si256(u, 1)));
+}
+
+KERN_TARGET_AVX2
+static inline __m256i op_epi32x8(int op, __m256i y, __m256i x, __m256i a) {
+    switch (op) {
+    case KERN_OP_SUM:   return _mm256_add_epi32(y, x);
+    case KERN_OP_SCALE: return _mm256_mullo_epi32(y, a);
+    default:            return _mm256_add_epi32(y, _mm256_mullo_epi32(a, x));
+    }
+}
+
+KERN_TARGET_AVX2
+static inline __m256 op_psx8(int op, __m256 y, __m256 x, __m256 a) {
+    switch (op) {
+    case KERN_OP_SUM:   return _mm256_add_ps(y, x);
+    case KERN_OP_SCALE: return _mm256_mul_ps(y, a);
+    default:            return _mm256_add_ps(y, _mm256_mul_ps(a, x));
+    }
+}
+
+KERN_TARGET_AVX2
+static inline void avx2_kernel(int op, kern_dtype_t type, void *yv, const void *xv,
+                               size_t n, float alpha) {
+    size_t i = 0;
+    
+    if (type == KERN_INT32) {
+        int32_t *y = yv;
+        const int32_t *x = xv;
+        __m256i a = _mm256_set1_epi32((int32_t)alpha), xs = _mm256_setzero_si256();
+        for (; i + 8 <= n; i += 8) {
+            __m256i ys = _mm256_loadu_si256((const __m256i *)(y + i));
+            if (op != KERN_OP_SCALE) xs = _mm256_loadu_si256((const __m256i *)(x + i));
+            _mm256_storeu_si256((__m256i *)(y + i), op_epi32x8(op, ys, xs, a));
+        }
+    } else if (type == KERN_FP32) {
+        float *y = yv;
+        const float *x = xv;
+        __m256 a = _mm256_set1_ps(alpha), xs = _mm256_setzero_ps();
+        for (; i + 8 <= n; i += 8) {
+            if (op != KERN_OP_SCALE) xs = _mm256_loadu_ps(x + i);
+            _mm256_storeu_ps(y + i, op_psx8(op, _mm256_loadu_ps(y + i), xs, a));
+        }
+    } else {
+        uint16_t *y = yv;
+        const uint16_t *x = xv;
+        __m256 a = _mm256_set1_ps(alpha), xs = _mm256_setzero_ps();
+        for (; i + 8 <= n; i += 8) {
+            if (op != KERN_OP_SCALE) xs = bf16x8_load(x + i);
+            bf16x8_store(y + i, op_psx8(op, bf16x8_load(y + i), xs, a));
+        }
+    }
+    scalar_tail(op, type, yv, xv, i, n, alpha);
+}
+
+// AVX-512: sixteen lanes
+KERN_TARGET_AVX512
+static inline __m512 bf16x16_load(const uint16_t *p) {
+    __m512i w = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i *)p));
+    return _mm512_castsi512_ps(_mm512_slli_epi32(w, 16));
+}
+
+KERN_TARGET_AVX512
+static inline void bf16x16_store(uint16_t *p, __m512 v) {
+    __m512i u = _mm512_castps_si512(v);
+    __mmask16 nan = _mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q);
+    __m512i lsb = _mm512_and_si512(_mm512_srli_epi32(u, 16), _mm512_set1_epi32(1));
+    
+    u = _mm512_add_epi32(u, _mm512_add_epi32(lsb, _mm512_set1_epi32(0x7fff)));
+    u = _mm512_mask_mov_epi32(u, nan, _mm512_set1_epi32(0x7fc00000));
+    _mm256_storeu_si256((__m256i *)p, _mm512_cvtepi32_epi16(_mm512_srli_epi32(u, 16)));
+}
+
+KERN_TARGET_AVX512
+static inline __m512i op_epi32x16(int op, __m512i y, __m512i x, __m512i a) {
+    switch (op) {
+    case KERN_OP_SUM:   return _mm512_add_epi32(y, x);
+    case KERN_OP_SCALE: return _mm512_mullo_epi32(y, a);
+    default:            return _mm512_add_epi32(y, _mm512_mullo_epi32(a, x));
+    }
+}
+
+KERN_TARGET_AVX512
+static inline __m512 op_psx16(int op, __m512 y, __m512 x, __m512 a) {
+    switch (op) {
+    case KERN_OP_SUM:   return _mm512_add_ps(y, x);
+    case KERN_OP_SCALE: return _mm512_mul_ps(y, a);
+    default:            return _mm512_add_ps(y, _mm512_mul_ps(a, x));
+    }
+}
+
+KERN_TARGET_AVX512
+static inline void avx512_kernel(int op, kern_dtype_t type, void *yv, const void *xv,
+                                 size_t n, float alpha) {
+    size_t i = 0;
+    
+    if (type == KERN_INT32) {
+        int32_t *y = yv;
+        const int32_t *x = xv;
+        __m512i a = _mm512_set1_epi32((int32_t)alpha), xs = _mm512_setzero_si512();
+        for (; i + 16 <= n; i += 16) {
+            __m512i ys = _mm512_loadu_si512(y + i);
+            if (op != KERN_OP_SCALE) xs = _mm512_loadu_si512(x + i);
+            _mm512_storeu_si512(y + i, op_epi32x16(op, ys, xs, a));
+        }
+    } else if (type == KERN_FP32) {
+        float *y = yv;
+        const float *x = xv;
+        __m512 a = _mm512_set1_ps(alpha), xs = _mm512_setzero_ps();
+        for (; i + 16 <= n; i += 16) {
+            if (op != KERN_OP_SCALE) xs = _mm512_loadu_ps(x + i);
+            _mm512_storeu_ps(y + i, op_psx16(op, _mm512_loadu_ps(y + i), xs, a));
+        }
+    } else {
+        uint16_t *y = yv;
+        const uint16_t *x = xv;
+        __m512 a = _mm512_set1_ps(alpha), xs = _mm512_setzero_ps();
+        for (; i + 16 <= n; i += 16) {
+            if (op != KERN_OP_SCALE) xs = bf16x16_load(x + i);
+            bf16x16_store(y + i, op_psx16(op, bf16x16_load(y + i), xs, a));
+        }
+    }
+    scalar_tail(op, type, yv, xv, i, n, alpha);
+}
+
+// One entry point per (op, type) so each kernel is specialised with both
+// known at compile time
+#define KERN_ENTRY(isa, target, op, type, name)                                 \
+    target static void isa##_##name(void *y, const void *x, size_t n, float a) { \
+        isa##_kernel(op, type, y, x, n, a);                                     \
+    }
+
+#define KERN_ENTRIES(isa, target)                                   \
+    KERN_ENTRY(isa, target, KERN_OP_SUM, KERN_INT32, sum_i32)       \
+    KERN_ENTRY(isa, target, KERN_OP_SUM, KERN_FP32, sum_f32)        \
+    KERN_ENTRY(isa, target, KERN_OP_SUM, KERN_BF16, sum_bf16)       \
+    KERN_ENTRY(isa, target, KERN_OP_SCALE, KERN_INT32, scale_i32)   \
+    KERN_ENTRY(isa, target, KERN_OP_SCALE, KERN_FP32, scale_f32)    \
+    KERN_ENTRY(isa, target, KERN_OP_SCALE, KERN_BF16, scale_bf16)   \
+    KERN_ENTRY(isa, target, KERN_OP_AXPY, KERN_INT32, axpy_i32)     \
+    KERN_ENTRY(isa, target, KERN_OP_AXPY, KERN_FP32, axpy_f32)      \
+    KERN_ENTRY(isa, target, KERN_OP_AXPY, KERN_BF16, axpy_bf16)     \
+    static const kern_fn isa##_table[KERN_NUM_OPS][KERN_NUM_TYPES] = { \
+        { isa##_sum_i32, isa##_sum_f32, isa##_sum_bf16 },           \
+        { isa##_scale_i32, isa##_scale_f32, isa##_scale_bf16 },     \
+        { isa##_axpy_i32, isa##_axpy_f32, isa##_axpy_bf16 }         \
+    };
+
+KERN_ENTRIES(scalar, )
+KERN_ENTRIES(avx2, KERN_TARGET_AVX2)
+KERN_ENTRIES(avx512, KERN_TARGET_AVX512)
+
+static void kern_init(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    
+    memcpy(kern_table, scalar_table, sizeof(kern_table));
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        memcpy(kern_table, avx512_table, sizeof(kern_table));
+        kern_isa_name = "avx512f";
+    } else if (__builtin_cpu_supports("avx2")) {
+        memcpy(kern_table, avx2_table, sizeof(kern_table));
+        kern_isa_name = "avx2";
+    }
+    
+    kern_threads = cpus < 1 ? 1 : cpus > KERN_MAX_THREADS ? KERN_MAX_THREADS : cpus;
+}
+
+typedef struct {
+    kern_fn fn;
+    char *y;
+    const char *x;
+    size_t n;
+    float alpha;
+} kern_slice_t;
+
+// Workers for large buffers, started on first use and kept for the life of
+// the process so a call costs a wakeup rather than thread creation. Worker k
+// runs slice k of each job; the caller runs slice 0 and any slice without a
+// worker.
+static struct {
+    pthread_mutex_t run;       // One multithreaded job at a time
+    pthread_mutex_t lock;      // Guards the rest
+    pthread_cond_t start;
+    pthread_cond_t done;
+    kern_slice_t slices[KERN_MAX_THREADS];
+    int num_slices;
+    int workers;
+    int pending;               // Worker slices of the current job still running
+    uint64_t gen;              // Bumped for every job
+    uint64_t seen[KERN_MAX_THREADS];  // Job each worker last looked at
+} kern_pool = {
+    .run = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER
+};
+
+static void run_slice(const kern_slice_t *s) {
+    s->fn(s->y, s->x, s->n, s->alpha);
+}
+
+static void *pool_worker(void *arg) {
+    int k = (int)(intptr_t)arg;
+    
+    for (;;) {
+        int mine;
+        
+        pthread_mutex_lock(&kern_pool.lock);
+        while (kern_pool.gen == kern_pool.seen[k]) {
+            pthread_cond_wait(&kern_pool.start, &kern_pool.lock);
+        }
+        kern_pool.seen[k] = kern_pool.gen;
+        mine = k < kern_pool.num_slices;
+        pthread_mutex_unlock(&kern_pool.lock);
+        if (!mine) continue;
+        
+        run_slice(&kern_pool.slices[k]);
+        
+        pthread_mutex_lock(&kern_pool.lock);
+        if (--kern_pool.pending == 0) pthread_cond_signal(&kern_pool.done);
+        pthread_mutex_unlock(&kern_pool.lock);
+    }
+    return NULL;
+}
+
+// Start workers 1..n-1 that don't exist yet; called with kern_pool.run held
+static void pool_grow(int n) {
+    while (kern_pool.workers + 1 < n) {
+        int k = kern_pool.workers + 1;
+        pthread_attr_t attr;
+        pthread_t tid;
+        int ok;
+        
+        kern_pool.seen[k] = kern_pool.gen;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        ok = pthread_create(&tid, &attr, pool_worker, (void *)(intptr_t)k) == 0;
+        pthread_attr_destroy(&attr);
+        if (!ok) return;
+        kern_pool.workers = k;
+    }
+}
+
+// Split large buffers into one slice per thread and run them on the pool
+static void kern_run(int op, kern_dtype_t type, void *y, const void *x,
+                     size_t count, float alpha) {
+    size_t esize, per;
+    int threads, helpers;
+    
+    pthread_once(&kern_once, kern_init);
+    esize = kern_type_size(type);
+    threads = count * esize >= KERN_MT_MIN_BYTES ? kern_threads : 1;
+    if (threads <= 1) {
+        kern_table[op][type](y, x, count, alpha);
+        return;
+    }
+    
+    // Whole multiples of 64 elements keep slices off each other's cache lines
+    per = ((count + threads - 1) / threads + 63) & ~(size_t)63;
+    threads = (count + per - 1) / per;
+    
+    pthread_mutex_lock(&kern_pool.run);
+    pool_grow(threads);
+    helpers = threads - 1 < kern_pool.workers ? threads - 1 : kern_pool.workers;
+    
+    pthread_mutex_lock(&kern_pool.lock);
+    for (int t = 0; t < threads; t++) {
+        kern_slice_t *s = &kern_pool.slices[t];
+        size_t off = t * per;
+        
+        s->fn = kern_table[op][type];
+        s->y = (char *)y + off * esize;
+        s->x = x ? (const char *)x + off * esize : NULL;
+        s->n = count - off < per ? count - off : per;
+        s->alpha = alpha;
+    }
+    kern_pool.num_slices = threads;
+    kern_pool.pending = helpers;
+    kern_pool.gen++;
+    pthread_cond_broadcast(&kern_pool.start);
+    pthread_mutex_unlock(&kern_pool.lock);
+    
+    run_slice(&kern_pool.slices[0]);
+    for (int t = helpers + 1; t < threads; t++) run_slice(&kern_pool.slices[t]);
+    
+    pthread_mutex_lock(&kern_pool.lock);
+    while (kern_pool.pending) pthread_cond_wait(&kern_pool.done, &kern_pool.lock);
+    pthread_mutex_unlock(&kern_pool.lock);
+    pthread_mutex_unlock(&kern_pool.run);
+}
+
+void kern_sum(void *dst, const void *src, size_t count, kern_dtype_t type) {
+    kern_run(KERN_OP_SUM, type, dst, src, count, 1.0f);
+}
+
+void kern_scale(void *buf, size_t count, kern_dtype_t type, float alpha) {
+    kern_run(KERN_OP_SCALE, type, buf, NULL, count, alpha);
+}
+
+void kern_axpy(void *y, const void *x, size_t count, kern_dtype_t type, float alpha) {
+    kern_run(KERN_OP_AXPY, type, y, x, count, alpha);
+}
+
+const char *kern_isa(void) {
+    pthread_once(&kern_once, kern_init);
+    return kern_isa_name;
+}
+
+void kern_set_threads(int threads) {
+    pthread_once(&kern_once, kern_init);
+    kern_threads = threads < 1 ? 1 : threads > KERN_MAX_THREADS ? KERN_MAX_THREADS : threads;
+}
@@ -0,0 +1,269 @@
+#include "rdma_kv.h"
+#include "rdma_crc32c.h"
+#include <stddef.h>
+
+// splitmix64 finalizer
+static uint64_t kv_hash(uint64_t key) {
+    key += 0x9e3779b97f4a7c15ULL;
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    return key ^ (key >> 31);
+}
+
+static uint32_t bucket_of(uint64_t key) {
+    return kv_hash(key) % KV_BUCKETS;
+}
+
+static uint32_t hint_of(uint64_t key) {
+    return (kv_hash(key) >> 32) % KV_HINTS;
+}
+
+// Offsets from the start of the store
+static uint64_t entry_off(uint32_t i) {
+    return (uint64_t)i * sizeof(struct kv_entry_t);
+}
+
+static uint64_t slab_off(uint32_t i) {
+    return KV_INDEX_SIZE + (uint64_t)i * KV_SLAB_SIZE;
+}
+
+static uint32_t slab_bytes(uint32_t len) {
+    return sizeof(struct kv_slab_hdr_t) + len;
+}
+
+static uint32_t slab_crc(const struct kv_slab_hdr_t *hdr, uint32_t len) {
+    uint32_t crc = crc32c(0, hdr, offsetof(struct kv_slab_hdr_t, crc));
+    return crc32c(crc, hdr + 1, len);
+}
+
+static void fill_slab(void *slab, uint64_t version, uint64_t key, const void *val, uint32_t len) {
+    struct kv_slab_hdr_t *hdr = slab;
+    
+    hdr->version = version;
+    hdr->key = key;
+    hdr->len = len;
+    memcpy(hdr + 1, val, len);
+    hdr->crc = slab_crc(hdr, len);
+}
+
+// Index within the probe window of the entry holding key (returns 1) or of
+// the first empty entry (returns 0); -1 if the window is full
+static int find_entry(struct kv_entry_t *win, uint64_t key, uint32_t *found) {
+    int empty = -1;
+    
+    for (int i = 0; i < KV_PROBE; i++) {
+        if (win[i].key == key) {
+            *found = i;
+            return 1;
+        }
+        if (empty < 0 && win[i].key == 0) empty = i;
+    }
+    if (empty < 0) return -1;
+    *found = empty;
+    return 0;
+}
+
+int kv_format(rdma_context_t *ctx) {
+    if (!ctx->buffer) {
+        fprintf(stderr, "KV store needs a CPU-visible buffer\n");
+        return -1;
+    }
+    if (ctx->buffer_size < KV_BASE_OFF + KV_REGION_SIZE) {
+        fprintf(stderr, "KV store needs a buffer of at least %zu bytes\n",
+                (size_t)(KV_BASE_OFF + KV_REGION_SIZE));
+        return -1;
+    }
+    
+    memset((char *)ctx->buffer + KV_BASE_OFF, 0, KV_INDEX_SIZE);
+    return 0;
+}
+
+int kv_put_local(rdma_context_t *ctx, uint64_t key, const void *val, uint32_t len) {
+    char *base = (char *)ctx->buffer + KV_BASE_OFF;
+    uint32_t b = bucket_of(key), i;
+    struct kv_entry_t *win = (struct kv_entry_t *)(base + entry_off(b));
+    
+    if (key == 0 || len > KV_MAX_VALUE) return KV_ERROR;
+    if (find_entry(win, key, &i) < 0) {
+        fprintf(stderr, "KV bucket %u is full\n", b);
+        return KV_ERROR;
+    }
+    
+    uint64_t version = win[i].lock_ver + 2;
+    fill_slab(base + slab_off(b + i), version, key, val, len);
+    win[i].key = key;
+    win[i].len = len;
+    win[i].lock_ver = version;
+    return 0;
+}
+
+int kv_client_init(kv_client_t *kv, rdma_context_t *ctx) {
+    memset(kv, 0, sizeof(*kv));
+    kv->ctx = ctx;
+    kv->remote_base = ctx->remote_props.addr + KV_BASE_OFF;
+    kv->rkey = ctx->remote_props.rkey;
+    
+    kv->win_off = KV_BASE_OFF;
+    kv->cas_off = kv->win_off + KV_PROBE * sizeof(struct kv_entry_t);
+    kv->slab_off = kv->cas_off + 64;
+    kv->put_off = kv->slab_off + KV_SLAB_SIZE;
+    kv->ent_off = kv->put_off + KV_SLAB_SIZE;
+    
+    if (!ctx->buffer || ctx->buffer_size < kv->ent_off + sizeof(struct kv_entry_t)) {
+        fprintf(stderr, "KV client needs a CPU-visible local buffer\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void *local(kv_client_t *kv, uint64_t off) {
+    return (char *)kv->ctx->buffer + off;
+}
+
+static int kv_read(kv_client_t *kv, uint64_t local_off, uint64_t remote_off, uint32_t len) {
+    kv->reads++;
+    if (post_rdma_to(kv->ctx, IBV_WR_RDMA_READ, local_off, kv->remote_base + remote_off,
+                     kv->rkey, len, 0) || poll_completion(kv->ctx) < 0) {
+        return KV_ERROR;
+    }
+    return 0;
+}
+
+// Read a slab and validate it: the expected key and length, an even version
+// that matches the index entry if one was read, and the CRC over the whole
+// slab, which is what catches a READ torn by a concurrent PUT.
+// Returns the value length, -1 if the slab did not validate, or KV_ERROR.
+static int read_slab(kv_client_t *kv, uint32_t entry, uint64_t key, uint64_t version,
+                     uint32_t len, void *val, uint32_t max) {
+    struct kv_slab_hdr_t *hdr = local(kv, kv->slab_off);
+    
+    if (kv_read(kv, kv->slab_off, slab_off(entry), slab_bytes(len))) return KV_ERROR;
+    
+    if (hdr->key != key || hdr->len != len || (hdr->version & 1) ||
+        (version && hdr->version != version) || hdr->crc != slab_crc(hdr, len)) {
+        return -1;
+    }
+    
+    memcpy(val, hdr + 1, len < max ? len : max);
+    return len;
+}
+
+int kv_get(kv_client_t *kv, uint64_t key, void *val, uint32_t max) {
+    struct kv_entry_t *win = local(kv, kv->win_off);
+    uint32_t b = bucket_of(key), h = hint_of(key);
+    
+    kv->gets++;
+    
+    // One READ when we know where the key lives; the slab's CRC validates it
+    if (kv->hint[h].key == key) {
+        int r = read_slab(kv, kv->hint[h].entry, key, 0, kv->hint[h].len, val, max);
+        if (r >= 0) {
+            kv->one_read_gets++;
+            return r;
+        }
+        if (r == KV_ERROR) return r;
+    }
+    
+    // Otherwise the probe window, then the slab it points at
+    for (int attempt = 0; attempt < KV_RETRIES; attempt++) {
+        uint32_t i;
+        
+        if (kv_read(kv, kv->win_off, entry_off(b), KV_PROBE * sizeof(struct kv_entry_t))) {
+            return KV_ERROR;
+        }
+        if (find_entry(win, key, &i) <= 0) {
+            kv->misses++;
+            return KV_MISS;
+        }
+        
+        uint64_t version = win[i].lock_ver;
+        uint32_t len = win[i].len;
+        if (!(version & 1) && len <= KV_MAX_VALUE) {
+            int r = read_slab(kv, b + i, key, version, len, val, max);
+            if (r >= 0) {
+                kv->hint[h].key = key;
+                kv->hint[h].entry = b + i;
+                kv->hint[h].len = len;
+                return r;
+            }
+            if (r == KV_ERROR) return r;
+        }
+        
+        // A writer holds the entry or moved it on under us
+        kv->retries++;
+    }
+    
+    fprintf(stderr, "KV GET %lu kept racing with writers\n", key);
+    return KV_ERROR;
+}
+
+// Lock the entry with a CAS on its version, write the slab, then write the
+// entry with the next even version, which also releases the lock. RC
+// executes the two WRITEs in order, and the 32-byte entry lands in one
+// cache line. Concurrent inserts of the same new key may both claim an
+// empty entry; updates of existing keys are serialized by the lock.
+int kv_put(kv_client_t *kv, uint64_t key, const void *val, uint32_t len) {
+    struct kv_entry_t *win = local(kv, kv->win_off);
+    uint32_t b = bucket_of(key), h = hint_of(key);
+    
+    if (key == 0 || len > KV_MAX_VALUE) return KV_ERROR;
+    
+    for (int attempt = 0; attempt < KV_RETRIES; attempt++) {
+        uint32_t i;
+        
+        if (kv_read(kv, kv->win_off, entry_off(b), KV_PROBE * sizeof(struct kv_entry_t))) {
+            return KV_ERROR;
+        }
+        if (find_entry(win, key, &i) < 0) {
+            fprintf(stderr, "KV bucket %u is full\n", b);
+            return KV_ERROR;
+        }
+        
+        uint64_t version = win[i].lock_ver;
+        uint64_t entry_addr = kv->remote_base + entry_off(b + i);
+        if (version & 1) {
+            kv->retries++;
+            continue;
+        }
+        
+        if (post_atomic(kv->ctx, IBV_WR_ATOMIC_CMP_AND_SWP, kv->cas_off, entry_addr,
+                        kv->rkey, version, version + 1, 0) || poll_completion(kv->ctx) < 0) {
+            return KV_ERROR;
+        }
+        if (*(uint64_t *)local(kv, kv->cas_off) != version) {
+            kv->cas_failures++;
+            continue;
+        }
+        
+        struct kv_entry_t *e = local(kv, kv->ent_off);
+        fill_slab(local(kv, kv->put_off), version + 2, key, val, len);
+        memset(e, 0, sizeof(*e));
+        e->lock_ver = version + 2;
+        e->key = key;
+        e->len = len;
+        
+        if (post_rdma_to(kv->ctx, IBV_WR_RDMA_WRITE, kv->put_off,
+                         kv->remote_base + slab_off(b + i), kv->rkey, slab_bytes(len), 0) ||
+            post_rdma_to(kv->ctx, IBV_WR_RDMA_WRITE, kv->ent_off, entry_addr,
+                         kv->rkey, sizeof(*e), 0) ||
+            poll_completion(kv->ctx) < 0 || poll_completion(kv->ctx) < 0) {
+            return KV_ERROR;
+        }
+        
+        kv->hint[h].key = key;
+        kv->hint[h].entry = b + i;
+        kv->hint[h].len = len;
+        kv->puts++;
+        return 0;
+    }
+    
+    fprintf(stderr, "KV PUT %lu kept losing the entry lock\n", key);
+    return KV_ERROR;
+}
+
+void kv_print_stats(kv_client_t *kv) {
+    printf("   - KV: %lu GETs (%lu with one READ, %lu misses), %lu PUTs\n",
+           kv->gets, kv->one_read_gets, kv->misses, kv->puts);
+    printf("   - KV: %lu READs, %lu retries, %lu CAS conflicts\n",
+           kv->reads, kv->retries, kv->cas_failures);
+}
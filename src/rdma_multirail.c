@@ -0,0 +1,251 @@
+#include "rdma_multirail.h"
+
+// Per-lane signalling rate in Mb/s for ibv_port_attr.active_speed
+static uint32_t lane_rate_mbps(uint8_t speed) {
+    switch (speed) {
+    case 1:   return 2500;    // SDR
+    case 2:   return 5000;    // DDR
+    case 4:                   // QDR
+    case 8:   return 10000;   // FDR10
+    case 16:  return 14000;   // FDR
+    case 32:  return 25000;   // EDR
+    case 64:  return 50000;   // HDR
+    case 128: return 100000;  // NDR
+    default:  return 10000;
+    }
+}
+
+static uint32_t lane_count(uint8_t width) {
+    switch (width) {
+    case 1:  return 1;
+    case 2:  return 4;
+    case 4:  return 8;
+    case 8:  return 12;
+    case 16: return 2;
+    default: return 1;
+    }
+}
+
+uint32_t port_rate_mbps(const struct ibv_port_attr *attr) {
+    return lane_rate_mbps(attr->active_speed) * lane_count(attr->active_width);
+}
+
+// Collect every active port of every HCA
+static int enumerate_active_ports(char names[][64], uint8_t *ports, int max) {
+    struct ibv_device **dev_list;
+    int num_devices, count = 0;
+    
+    dev_list = ibv_get_device_list(&num_devices);
+    if (!dev_list) return -1;
+    
+    for (int i = 0; i < num_devices && count < max; i++) {
+        struct ibv_context *ib_ctx = ibv_open_device(dev_list[i]);
+        struct ibv_device_attr dev_attr;
+        
+        if (!ib_ctx) continue;
+        if (ibv_query_device(ib_ctx, &dev_attr)) {
+            ibv_close_device(ib_ctx);
+            continue;
+        }
+        
+        for (uint8_t p = 1; p <= dev_attr.phys_port_cnt && count < max; p++) {
+            struct ibv_port_attr port_attr;
+            if (ibv_query_port(ib_ctx, p, &port_attr) || port_attr.state != IBV_PORT_ACTIVE) {
+                continue;
+            }
+            snprintf(names[count], 64, "%s", ibv_get_device_name(dev_list[i]));
+            ports[count] = p;
+            count++;
+        }
+        ibv_close_device(ib_ctx);
+    }
+    
+    ibv_free_device_list(dev_list);
+    return count;
+}
+
+// Parse "dev[:port],dev[:port],..."
+static int parse_rail_spec(const char *spec, char names[][64], uint8_t *ports, int max) {
+    char *copy = strdup(spec), *saveptr = NULL;
+    int count = 0;
+    
+    if (!copy) return -1;
+    
+    for (char *tok = strtok_r(copy, ",", &saveptr); tok && count < max;
+         tok = strtok_r(NULL, ",", &saveptr)) {
+        char *colon = strchr(tok, ':');
+        ports[count] = 1;
+        if (colon) {
+            *colon = '\0';
+            ports[count] = atoi(colon + 1);
+        }
+        snprintf(names[count], 64, "%s", tok);
+        count++;
+    }
+    
+    free(copy);
+    return count;
+}
+
+int multirail_init(multirail_t *mr, rdma_context_t *primary, const char *spec) {
+    char names[RDMA_MAX_RAILS][64];
+    uint8_t ports[RDMA_MAX_RAILS];
+    int n;
+    
+    memset(mr, 0, sizeof(*mr));
+    
+    if (strcmp(spec, "all") == 0) {
+        n = enumerate_active_ports(names, ports, RDMA_MAX_RAILS);
+    } else {
+        n = parse_rail_spec(spec, names, ports, RDMA_MAX_RAILS);
+    }
+    if (n <= 0) {
+        fprintf(stderr, "No rails selected\n");
+        return -1;
+    }
+    
+    for (int i = 0; i < n; i++) {
+        rdma_context_t *rail = &mr->rails[mr->num_rails];
+        
+        memset(rail, 0, sizeof(*rail));
+        rail->gaudi_fd = -1;
+        rail->sock = -1;
+        rail->dmabuf_fd = primary->dmabuf_fd;
+        rail->device_va = primary->device_va;
+        rail->buffer = primary->buffer;
+        rail->buffer_size = primary->buffer_size;
+        rail->odp_mode = primary->odp_mode;
+        rail->traffic_class = primary->traffic_class;
+        rail->ib_port = ports[i];
+        
+        printf("Rail %d: %s port %d\n", mr->num_rails, names[i], ports[i]);
+        if (init_rdma_resources(rail, names[i]) < 0) {
+            printf("Skipping rail %s:%d (init failed)\n", names[i], ports[i]);
+            cleanup_ib_resources(rail);
+            continue;
+        }
+        if (rail->port_attr.state != IBV_PORT_ACTIVE) {
+            printf("Skipping rail %s:%d (port not active)\n", names[i], ports[i]);
+            cleanup_ib_resources(rail);
+            continue;
+        }
+        
+        mr->weight[mr->num_rails] = port_rate_mbps(&rail->port_attr);
+        mr->num_rails++;
+    }
+    
+    if (mr->num_rails == 0) {
+        fprintf(stderr, "No usable rails\n");
+        return -1;
+    }
+    return 0;
+}
+
+int multirail_connect(multirail_t *mr, rdma_context_t *primary,
+                      const char *server_name, int port) {
+    uint32_t local_n = htonl(mr->num_rails), remote_n;
+    
+    // Both sides use the smaller rail count
+    if (write(primary->sock, &local_n, sizeof(local_n)) != sizeof(local_n) ||
+        read(primary->sock, &remote_n, sizeof(remote_n)) != sizeof(remote_n)) {
+        fprintf(stderr, "Failed to exchange rail count\n");
+        return -1;
+    }
+    remote_n = ntohl(remote_n);
+    while (mr->num_rails > (int)remote_n) {
+        cleanup_ib_resources(&mr->rails[--mr->num_rails]);
+    }
+    
+    for (int i = 0; i < mr->num_rails; i++) {
+        rdma_context_t *rail = &mr->rails[i];
+        int tries = 0;
+        
+        // The client may get ahead of the server's listen(), so retry connects
+        while (connect_qp(rail, server_name, port + 1 + i) < 0) {
+            if (!server_name || rail->sock >= 0 || ++tries >= 500) {
+                fprintf(stderr, "Failed to connect rail %d\n", i);
+                return -1;
+            }
+            usleep(10000);
+        }
+    }
+    
+    printf("%d rail(s) connected\n", mr->num_rails);
+    return 0;
+}
+
+int multirail_transfer(multirail_t *mr, int opcode, uint64_t offset, size_t len) {
+    uint64_t seg_off[RDMA_MAX_RAILS], seg_len[RDMA_MAX_RAILS], posted[RDMA_MAX_RAILS];
+    int outstanding[RDMA_MAX_RAILS] = {0};
+    struct ibv_wc wc[RAIL_WINDOW];
+    uint64_t total_weight = 0, off = offset;
+    int active;
+    
+    for (int i = 0; i < mr->num_rails; i++) total_weight += mr->weight[i];
+    
+    // Split the range into one contiguous, page-aligned segment per rail
+    for (int i = 0; i < mr->num_rails; i++) {
+        uint64_t share = (len * mr->weight[i] / total_weight) & ~4095ULL;
+        if (i == mr->num_rails - 1) share = offset + len - off;
+        seg_off[i] = off;
+        seg_len[i] = share;
+        posted[i] = 0;
+        off += share;
+    }
+    
+    do {
+        active = 0;
+        for (int i = 0; i < mr->num_rails; i++) {
+            rdma_context_t *rail = &mr->rails[i];
+            
+            while (outstanding[i] < RAIL_WINDOW && posted[i] < seg_len[i]) {
+                uint64_t chunk = seg_len[i] - posted[i];
+                if (chunk > RAIL_CHUNK_SIZE) chunk = RAIL_CHUNK_SIZE;
+                
+                if (post_rdma_range(rail, opcode, seg_off[i] + posted[i],
+                                    seg_off[i] + posted[i], chunk, i)) {
+                    fprintf(stderr, "Failed to post on rail %d\n", i);
+                    return -1;
+                }
+                posted[i] += chunk;
+                outstanding[i]++;
+            }
+            
+            if (outstanding[i]) {
+                int ne = ibv_poll_cq(rail->cq, RAIL_WINDOW, wc);
+                if (ne < 0) {
+                    fprintf(stderr, "Poll CQ failed on rail %d\n", i);
+                    return -1;
+                }
+                for (int j = 0; j < ne; j++) {
+                    if (wc[j].status != IBV_WC_SUCCESS) {
+                        fprintf(stderr, "Rail %d work completion error: %s\n",
+                                i, ibv_wc_status_str(wc[j].status));
+                        return -1;
+                    }
+                }
+                outstanding[i] -= ne;
+            }
+            
+            if (outstanding[i] || posted[i] < seg_len[i]) active = 1;
+        }
+    } while (active);
+    
+    for (int i = 0; i < mr->num_rails; i++) mr->bytes[i] += seg_len[i];
+    return 0;
+}
+
+void multirail_print(multirail_t *mr) {
+    for (int i = 0; i < mr->num_rails; i++) {
+        printf("   - Rail %d: %s port %d, %u Gb/s, %lu bytes\n", i,
+               mr->rails[i].ib_dev_name, mr->rails[i].ib_port,
+               mr->weight[i] / 1000, mr->bytes[i]);
+    }
+}
+
+void multirail_cleanup(multirail_t *mr) {
+    for (int i = 0; i < mr->num_rails; i++) {
+        cleanup_ib_resources(&mr->rails[i]);
+    }
+    mr->num_rails = 0;
+}
@@ -0,0 +1,122 @@
+#include "rdma_mw.h"
+
+int mw_supported(rdma_context_t *ctx) {
+    return (ctx->dev_attr.device_cap_flags &
+            (IBV_DEVICE_MEM_WINDOW_TYPE_2A | IBV_DEVICE_MEM_WINDOW_TYPE_2B)) != 0;
+}
+
+int mw_alloc(rdma_context_t *ctx, rdma_window_t *w) {
+    memset(w, 0, sizeof(*w));
+    
+    if (!mw_supported(ctx)) {
+        fprintf(stderr, "Device does not support type-2 memory windows\n");
+        return -1;
+    }
+    
+    w->mw = ibv_alloc_mw(ctx->pd, IBV_MW_TYPE_2);
+    if (!w->mw) {
+        fprintf(stderr, "Failed to allocate memory window\n");
+        return -1;
+    }
+    w->rkey = w->mw->rkey;
+    return 0;
+}
+
+int mw_bind(rdma_context_t *ctx, rdma_window_t *w, uint64_t offset,
+            uint64_t len, int access) {
+    if (offset + len > ctx->buffer_size) {
+        fprintf(stderr, "Window exceeds the registered buffer\n");
+        return -1;
+    }
+    
+    // A type-2 window must be invalid before it can be bound again
+    if (w->bound && mw_invalidate(ctx, w)) return -1;
+    
+    // A fresh key byte makes every rkey handed out before this bind useless
+    uint32_t rkey = ibv_inc_rkey(w->rkey);
+    struct ibv_send_wr wr = {
+        .wr_id = 0,
+        .opcode = IBV_WR_BIND_MW,
+        .send_flags = IBV_SEND_SIGNALED,
+        .bind_mw = {
+            .mw = w->mw,
+            .rkey = rkey,
+            .bind_info = {
+                .mr = ctx->mr,
+                .addr = buffer_addr(ctx) + offset,
+                .length = len,
+                .mw_access_flags = access
+            }
+        }
+    }, *bad_wr;
+    
+    if (ibv_post_send(ctx->qp, &wr, &bad_wr)) {
+        fprintf(stderr, "Failed to post window bind\n");
+        return -1;
+    }
+    if (poll_completion(ctx) < 0) {
+        fprintf(stderr, "Window bind failed\n");
+        return -1;
+    }
+    
+    w->rkey = rkey;
+    w->addr = buffer_addr(ctx) + offset;
+    w->len = len;
+    w->access = access;
+    w->bound = 1;
+    return 0;
+}
+
+int mw_invalidate(rdma_context_t *ctx, rdma_window_t *w) {
+    struct ibv_send_wr wr = {
+        .wr_id = 0,
+        .opcode = IBV_WR_LOCAL_INV,
+        .send_flags = IBV_SEND_SIGNALED,
+        .invalidate_rkey = w->rkey
+    }, *bad_wr;
+    
+    if (!w->bound) return 0;
+    
+    if (ibv_post_send(ctx->qp, &wr, &bad_wr)) {
+        fprintf(stderr, "Failed to post window invalidation\n");
+        return -1;
+    }
+    if (poll_completion(ctx) < 0) {
+        fprintf(stderr, "Window invalidation failed\n");
+        return -1;
+    }
+    
+    w->bound = 0;
+    return 0;
+}
+
+int mw_publish(rdma_context_t *ctx, rdma_window_t *w) {
+    struct mw_grant_t grant = {
+        .addr = htonll(w->addr),
+        .len = htonll(w->len),
+        .rkey = htonl(w->rkey),
+        .access = htonl(w->access)
+    };
+    
+    return write(ctx->sock, &grant, sizeof(grant)) == sizeof(grant) ? 0 : -1;
+}
+
+int mw_recv_grant(rdma_context_t *ctx, struct mw_grant_t *grant) {
+    size_t got = 0;
+    
+    while (got < sizeof(*grant)) {
+        ssize_t n = read(ctx->sock, (char *)grant + got, sizeof(*grant) - got);
+        if (n <= 0) return -1;
+        got += n;
+    }
+    grant->addr = ntohll(grant->addr);
+    grant->len = ntohll(grant->len);
+    grant->rkey = ntohl(grant->rkey);
+    grant->access = ntohl(grant->access);
+    return 0;
+}
+
+void mw_free(rdma_window_t *w) {
+    if (w->mw) ibv_dealloc_mw(w->mw);
+    memset(w, 0, sizeof(*w));
+}
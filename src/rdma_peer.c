@@ -0,0 +1,113 @@
+#include "rdma_common.h"
+#include "rdma_conn_pool.h"
+
+// One process of an N-peer job. Every peer writes a message into every
+// other peer's buffer, connecting lazily through the connection pool.
+int main(int argc, char *argv[]) {
+    rdma_context_t ctx = {0};
+    ctx.gaudi_fd = -1;
+    ctx.dmabuf_fd = -1;
+    ctx.sock = -1;
+    ctx.no_qp = 1;  // Every QP belongs to a pooled connection
+    
+    int my_id = -1;
+    char *peer_list = NULL;
+    char *ib_dev_name = NULL;
+    int qp_budget = 64;
+    int rounds = 3;
+    int linger_ms = 2000;
+    size_t buffer_size = RDMA_BUFFER_SIZE;
+    conn_pool_t pool;
+    
+    // Parse arguments
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            my_id = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            peer_list = argv[++i];
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            ib_dev_name = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            qp_budget = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            linger_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            buffer_size = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-h") == 0) {
+            printf("Usage: %s -i id -l host:port,host:port,... [-d ib_dev] [-b qp_budget] [-n rounds] [-w linger_ms] [-s buffer_size]\n", argv[0]);
+            return 0;
+        }
+    }
+    
+    if (my_id < 0 || !peer_list) {
+        fprintf(stderr, "Error: -i and -l are required\n");
+        return 1;
+    }
+    
+    printf("RDMA DMA-buf Peer\n");
+    printf("=================\n");
+    printf("Peer id: %d\n", my_id);
+    printf("Buffer size: %zu bytes\n", buffer_size);
+    if (ib_dev_name) printf("IB device: %s\n", ib_dev_name);
+    printf("\n");
+    
+    // One device, PD, MR and CQ for the whole job
+    if (init_gaudi_dmabuf(&ctx, buffer_size) < 0 ||
+        init_rdma_resources(&ctx, ib_dev_name) < 0) {
+        fprintf(stderr, "Failed to initialize RDMA resources\n");
+        cleanup_resources(&ctx);
+        return 1;
+    }
+    printf("✓ RDMA resources initialized on %s\n", ctx.ib_dev_name);
+    
+    if (conn_pool_init(&pool, &ctx, my_id, peer_list, qp_budget) < 0) {
+        cleanup_resources(&ctx);
+        return 1;
+    }
+    
+    if (ctx.buffer) {
+        int *int_data = (int *)ctx.buffer;
+        for (size_t i = 0; i < MSG_SIZE / sizeof(int); i++) {
+            int_data[i] = my_id * 1000 + i;
+        }
+    }
+    
+    // Each peer owns a MSG_SIZE slot in everyone else's buffer
+    uint64_t slots = buffer_size / MSG_SIZE - 1;
+    uint64_t remote_off = MSG_SIZE * (1 + my_id % slots);
+    uint64_t writes = 0, failures = 0;
+    double start = now_ms();
+    
+    for (int r = 0; r < rounds; r++) {
+        for (int p = 0; p < pool.num_peers; p++) {
+            if (p == my_id) continue;
+            
+            if (conn_pool_write(&pool, p, 0, remote_off, MSG_SIZE) == 0) {
+                writes++;
+            } else {
+                failures++;
+            }
+            conn_pool_progress(&pool);
+        }
+    }
+    double elapsed = now_ms() - start;
+    
+    // Keep serving connection requests while slower peers finish
+    printf("Lingering %d ms for other peers...\n", linger_ms);
+    double deadline = now_ms() + linger_ms;
+    while (now_ms() < deadline) {
+        conn_pool_progress(&pool);
+        usleep(1000);
+    }
+    
+    printf("\nSummary:\n");
+    printf("✓ %lu write(s) to %d peer(s) in %.1f ms, %lu failed\n",
+           writes, pool.num_peers - 1, elapsed, failures);
+    conn_pool_print(&pool);
+    
+    conn_pool_destroy(&pool);
+    cleanup_resources(&ctx);
+    return failures ? 1 : 0;
+}
@@ -1,4 +1,21 @@
 #include "rdma_common.h"
+#include "rdma_multirail.h"
+#include "rdma_topology.h"
+#include "rdma_startup.h"
+#include "rdma_transfer.h"
+#include "rdma_ud.h"
+#include "rdma_mw.h"
+#include "rdma_kv.h"
+#include "rdma_cache.h"
+#include "rdma_kernels.h"
+#include <poll.h>
+
+// Host processing of the client's bulk write, applied chunk by chunk as the
+// data lands
+static void scale_chunk(void *data, size_t len, void *arg) {
+    (void)arg;
+    kern_scale(data, len / sizeof(int), KERN_INT32, 2);
+}
 
 int main(int argc, char *argv[]) {
     rdma_context_t ctx = {0};
@@ -8,7 +25,19 @@ int main(int argc, char *argv[]) {
     
     int port = 20000;
     char *ib_dev_name = NULL;
+    char *rail_spec = NULL;
     size_t buffer_size = RDMA_BUFFER_SIZE;
+    multirail_t rails = {0};
+    rdma_window_t session = {0};  // With -w: the client's access to the whole buffer
+    char *accel_spec = NULL;
+    char bus_ids[RDMA_MAX_ACCELS][16];
+    rdma_context_t accels[RDMA_MAX_ACCELS - 1];  // Accelerators beyond the primary
+    int num_accels = 0, num_extra = 0;
+    ud_endpoint_t ud = {0};
+    int use_ud = 0, ud_peer = -1;
+    int use_mw = 0;
+    int use_kv = 0;
+    int use_cache = 0;
     
     // Parse arguments
     for (int i = 1; i < argc; i++) {
@@ -18,23 +47,81 @@ int main(int argc, char *argv[]) {
             ib_dev_name = argv[++i];
         } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
             buffer_size = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            ctx.traffic_class = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+            ctx.gid_index = atoi(argv[++i]);
+            ctx.gid_index_set = 1;
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            accel_spec = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            rail_spec = argv[++i];
+        } else if (strcmp(argv[i], "-u") == 0) {
+            use_ud = 1;
+        } else if (strcmp(argv[i], "-c") == 0) {
+            use_cache = 1;
+        } else if (strcmp(argv[i], "-k") == 0) {
+            use_kv = 1;
+        } else if (strcmp(argv[i], "-w") == 0) {
+            use_mw = 1;
+            ctx.mw_bind = 1;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            ctx.odp_mode = parse_odp_mode(argv[++i]);
+            if (ctx.odp_mode < 0) {
+                fprintf(stderr, "Error: ODP mode must be off, auto, explicit or implicit\n");
+                return 1;
+            }
         } else if (strcmp(argv[i], "-h") == 0) {
-            printf("Usage: %s [-p port] [-d ib_dev] [-s buffer_size]\n", argv[0]);
+            printf("Usage: %s [-p port] [-d ib_dev] [-s buffer_size] [-o odp_mode] [-r rails] [-g accels] [-t tclass] [-x gid_index] [-u] [-w] [-k] [-c]\n", argv[0]);
             return 0;
         }
     }
     
+    // A type-2 window belongs to one QP, so rails would have no rkey to use
+    if (use_mw && rail_spec) {
+        fprintf(stderr, "Error: -w cannot be combined with -r\n");
+        return 1;
+    }
+    
     printf("RDMA DMA-buf Server\n");
     printf("===================\n");
     printf("Port: %d\n", port);
     printf("Buffer size: %zu bytes\n", buffer_size);
     if (ib_dev_name) printf("IB device: %s\n", ib_dev_name);
+    if (ctx.odp_mode) printf("ODP mode: %s\n", odp_mode_str(ctx.odp_mode));
+    if (rail_spec) printf("Rails: %s\n", rail_spec);
+    if (accel_spec) printf("Accelerators: %s\n", accel_spec);
+    if (use_ud) printf("UD control messages: on\n");
+    if (use_mw) printf("Memory windows: on\n");
+    if (use_kv) printf("KV store: on\n");
+    if (use_cache) printf("Read cache: on\n");
     printf("\n");
     
-    // Initialize Gaudi DMA-buf
-    printf("Initializing Gaudi DMA-buf...\n");
-    if (init_gaudi_dmabuf(&ctx, buffer_size) < 0) {
-        fprintf(stderr, "Failed to initialize Gaudi DMA-buf\n");
+    if (accel_spec) {
+        num_accels = parse_accel_list(accel_spec, bus_ids, RDMA_MAX_ACCELS);
+        if (num_accels < 0) {
+            fprintf(stderr, "Invalid accelerator list: %s\n", accel_spec);
+            return 1;
+        }
+        if (num_accels == 0) {
+            printf("No accelerators found, using a host-memory stand-in\n");
+            num_accels = 0;
+        } else {
+            snprintf(ctx.gaudi_bus_id, sizeof(ctx.gaudi_bus_id), "%s", bus_ids[0]);
+        }
+    }
+    
+    // Bring up the accelerator, RDMA resources and the client connection
+    // with independent phases overlapped
+    printf("Starting up, waiting for client connection on port %d...\n", port);
+    rdma_startup_t startup = {
+        .ib_dev_name = ib_dev_name,
+        .server_name = NULL,
+        .port = port,
+        .buffer_size = buffer_size
+    };
+    if (parallel_startup(&ctx, &startup) < 0) {
+        fprintf(stderr, "Failed to establish connection\n");
         cleanup_resources(&ctx);
         return 1;
     }
@@ -44,24 +131,71 @@ int main(int argc, char *argv[]) {
     } else {
         printf("✓ Using regular memory buffer\n");
     }
+    printf("✓ RDMA resources initialized on %s\n", ctx.ib_dev_name);
+    printf("✓ Client connected\n");
+    print_startup_timing(&startup);
     
-    // Initialize RDMA resources
-    printf("\nInitializing RDMA resources...\n");
-    if (init_rdma_resources(&ctx, ib_dev_name) < 0) {
-        fprintf(stderr, "Failed to initialize RDMA resources\n");
-        cleanup_resources(&ctx);
-        return 1;
+    // The handshake published no MR rkey; the client's access to the buffer
+    // is a window, bound now that the QP is up (length 0 if that failed)
+    if (use_mw) {
+        int ok = mw_alloc(&ctx, &session) == 0 &&
+                 mw_bind(&ctx, &session, 0, ctx.buffer_size, IBV_ACCESS_REMOTE_READ |
+                         IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_ATOMIC) == 0;
+        if (mw_publish(&ctx, &session) < 0 || !ok) {
+            fprintf(stderr, "Failed to grant buffer access through a window\n");
+            mw_free(&session);
+            cleanup_resources(&ctx);
+            return 1;
+        }
+        printf("✓ Buffer access granted through window rkey 0x%x\n", session.rkey);
     }
-    printf("✓ RDMA resources initialized\n");
     
-    // Wait for client connection
-    printf("\nWaiting for client connection on port %d...\n", port);
-    if (connect_qp(&ctx, NULL, port) < 0) {
-        fprintf(stderr, "Failed to establish connection\n");
-        cleanup_resources(&ctx);
-        return 1;
+    // Each further accelerator gets its own DMA-buf on its own paired NIC
+    if (num_accels > 1) {
+        printf("\nOpening %d more accelerator(s)...\n", num_accels - 1);
+        num_extra = open_accelerators(accels, bus_ids + 1, num_accels - 1,
+                                      buffer_size, ctx.odp_mode);
+        if (num_extra < 0) {
+            fprintf(stderr, "Failed to open accelerators\n");
+            cleanup_resources(&ctx);
+            return 1;
+        }
+        if (accel_connect(accels, &num_extra, &ctx, NULL, port) < 0) {
+            fprintf(stderr, "Failed to connect accelerators\n");
+            close_accelerators(accels, num_extra);
+            cleanup_resources(&ctx);
+            return 1;
+        }
+        printf("✓ %d accelerator(s) ready, %d pair(s) connected\n", num_extra + 1, num_extra);
+    }
+    
+    // Bring up the additional rails
+    if (rail_spec) {
+        printf("\nSetting up rails...\n");
+        if (multirail_init(&rails, &ctx, rail_spec) < 0 ||
+            multirail_connect(&rails, &ctx, NULL, port) < 0) {
+            fprintf(stderr, "Failed to set up rails\n");
+            multirail_cleanup(&rails);
+            close_accelerators(accels, num_extra);
+            cleanup_resources(&ctx);
+            return 1;
+        }
+        printf("✓ %d rail(s) ready\n", rails.num_rails);
+    }
+    
+    // One UD QP for small control messages, addressed like the RC peer
+    if (use_ud) {
+        printf("\nSetting up UD endpoint...\n");
+        if (ud_init(&ud, &ctx) < 0 || (ud_peer = ud_connect(&ud, ctx.sock)) < 0) {
+            fprintf(stderr, "Failed to set up UD endpoint\n");
+            ud_destroy(&ud);
+            multirail_cleanup(&rails);
+            close_accelerators(accels, num_extra);
+            cleanup_resources(&ctx);
+            return 1;
+        }
+        printf("✓ UD endpoint ready\n");
     }
-    printf("✓ Client connected\n");
     
     // Function to display buffer data (first few integers)
     void display_buffer_data(const char *label, void *buffer, size_t size) {
@@ -126,11 +260,8 @@ int main(int argc, char *argv[]) {
             
             // Simulate HPU processing: multiply each value by 2
             printf("[HPU] Processing data (multiplying by 2)...\n");
-            int *int_data = (int *)ctx.buffer;
             int count = MSG_SIZE / sizeof(int);
-            for (int j = 0; j < count && j < 256; j++) {  // Process first 256 ints
-                int_data[j] *= 2;
-            }
+            kern_scale(ctx.buffer, count < 256 ? count : 256, KERN_INT32, 2);  // Process first 256 ints
             
             display_buffer_data("[CPU] After HPU processing", ctx.buffer, MSG_SIZE);
         } else {
@@ -172,10 +303,163 @@ int main(int argc, char *argv[]) {
         printf("✓ RDMA Write completed\n");
     }
     
+    // The client's further accelerators write to ours pairwise
+    if (num_extra) {
+        printf("\n--- Multi-accelerator RDMA Write Test ---\n");
+        printf("Serving writes on %d accelerator pair(s)...\n", num_extra);
+        uint64_t bytes;
+        if (accel_transfer(accels, num_extra, 1, &bytes) < 0) {
+            fprintf(stderr, "Multi-accelerator write failed\n");
+        } else {
+            printf("✓ Client wrote %lu bytes across %d accelerator(s)\n", bytes, num_extra);
+        }
+    }
+    
+    // Client's bulk RDMA Write; we only take part in QP recoveries
+    printf("\n--- Bulk RDMA Write Test ---\n");
+    printf("Serving client's bulk write...\n");
+    // The received data is processed on the host before the client reads
+    // it back, per chunk while the rest is in flight when checksums are on
+    rdma_xfer_t bulk = { .process = ctx.buffer ? scale_chunk : NULL };
+    if (xfer_serve(&ctx, &bulk) < 0) {
+        fprintf(stderr, "Bulk write failed\n");
+    } else {
+        if (bulk.crc_errors) {
+            printf("⚠️  Client wrote %lu bytes, %lu chunk(s) failed CRC32C\n", bulk.acked, bulk.crc_errors);
+        } else {
+            printf("✓ Client wrote %lu bytes%s\n", bulk.acked, bulk.checksum ? ", CRC32C verified" : "");
+        }
+        if (bulk.process) {
+            printf("[CPU] Scaled %lu bytes %s, %.3f ms CPU (%.2f GB/s, %s)\n", bulk.acked,
+                   bulk.checksum ? "as chunks landed" : "after the transfer", bulk.process_ms,
+                   bulk.process_ms > 0 ? bulk.acked / (bulk.process_ms * 1e6) : 0.0, kern_isa());
+        }
+    }
+    
+    // Client pulls our buffer with the read engine
+    printf("\n--- RDMA Read Engine Test ---\n");
+    printf("Serving client's RDMA Reads (up to %d outstanding)...\n", ctx.max_dest_rd_atomic);
+    rdma_xfer_t pull = {0};
+    if (xfer_serve(&ctx, &pull) < 0) {
+        fprintf(stderr, "Read engine failed\n");
+    } else {
+        printf("✓ Client read %lu bytes\n", pull.acked);
+    }
+    
+    // Lay out and seed the KV store; the client's GETs and PUTs then run
+    // entirely one-sided
+    if (use_kv) {
+        const int kv_keys = 256, kv_ints = 64;
+        int value[kv_ints], seeded = 0;
+        uint32_t type;
+        uint64_t status;
+        
+        printf("\n--- One-sided KV Store Test ---\n");
+        if (kv_format(&ctx) == 0) {
+            for (; seeded < kv_keys; seeded++) {
+                for (int j = 0; j < kv_ints; j++) value[j] = (seeded + 1) * 1000 + j;
+                if (kv_put_local(&ctx, seeded + 1, value, sizeof(value)) < 0) break;
+            }
+            printf("✓ Seeded %d keys (%zu-byte values) at offset %d\n",
+                   seeded, sizeof(value), KV_BASE_OFF);
+        }
+        send_ctrl(&ctx, CTRL_DONE, seeded);
+        
+        if (seeded) {
+            printf("Serving GETs and PUTs without the CPU...\n");
+            if (recv_ctrl(&ctx, &type, &status) == 0) {
+                printf("✓ Client finished with the store\n");
+            }
+        }
+    }
+    
+    // The client caches reads of our buffer; change a page it has cached and
+    // bump its epoch word so the copy is refetched
+    if (use_cache) {
+        uint32_t type;
+        uint64_t epoch_off, status;
+        
+        printf("\n--- Client-side Cache Test ---\n");
+        if (recv_ctrl(&ctx, &type, &epoch_off) == 0 && epoch_off != UINT64_MAX) {
+            printf("Client epoch word at offset 0x%lx, waiting for its reads...\n", epoch_off);
+            if (recv_ctrl(&ctx, &type, &status) == 0) {
+                int modified = 0;
+                
+                if (ctx.buffer) {
+                    int *int_data = (int *)ctx.buffer;
+                    for (int j = 0; j < 1024; j++) int_data[j] = 7000000 + j;
+                    modified = 1;
+                }
+                cache_owner_t owner;
+                if (cache_owner_init(&owner, &ctx) == 0 &&
+                    cache_bump_epoch(&owner, epoch_off) == 0) {
+                    printf("✓ %s the client's epoch\n", modified ? "Updated page 0 and bumped" : "Bumped");
+                }
+                cache_owner_destroy(&owner);
+                send_ctrl(&ctx, CTRL_DONE, modified);
+            }
+        }
+    }
+    
+    // Grant the client write access to one slot through a memory window,
+    // then revoke it
+    if (use_mw) {
+        rdma_window_t win;
+        uint32_t type;
+        uint64_t value;
+        
+        printf("\n--- Memory Window Test ---\n");
+        double start = now_ms();
+        int ok = mw_alloc(&ctx, &win) == 0 &&
+                 mw_bind(&ctx, &win, MSG_SIZE, MSG_SIZE, IBV_ACCESS_REMOTE_WRITE) == 0;
+        double bind_ms = now_ms() - start;
+        
+        // An unbound window is published with length 0 so the client skips the test
+        if (mw_publish(&ctx, &win) < 0) {
+            fprintf(stderr, "Failed to publish window\n");
+        } else if (ok) {
+            printf("✓ Window over bytes %d-%d bound in %.3f ms (MR registration: %.3f ms), rkey 0x%x\n",
+                   MSG_SIZE, 2 * MSG_SIZE - 1, bind_ms, ctx.mr_reg_ms, win.rkey);
+            
+            if (recv_ctrl(&ctx, &type, &value) == 0 && value == 0) {
+                printf("✓ Client wrote through the window\n");
+                if (ctx.buffer) {
+                    display_buffer_data("Window contents", (char *)ctx.buffer + MSG_SIZE, MSG_SIZE);
+                }
+            }
+            if (mw_invalidate(&ctx, &win) == 0) {
+                printf("✓ Window invalidated\n");
+            }
+            send_ctrl(&ctx, CTRL_DONE, 0);
+        } else {
+            fprintf(stderr, "Memory window setup failed\n");
+        }
+        mw_free(&win);
+    }
+    
     // Wait for client to finish
     printf("\nWaiting for client to finish...\n");
     char sync_byte;
-    if (read(ctx.sock, &sync_byte, 1) == 1) {
+    if (use_ud) {
+        char msg[UD_MSG_SIZE];
+        int n, echoed = 0;
+        
+        // Echo pings until the done message arrives
+        while ((n = ud_recv(&ud, NULL, msg, sizeof(msg), 10000)) > 0 && msg[0] == 'P') {
+            if (ud_send(&ud, ud_peer, msg, n) < 0) break;
+            echoed++;
+        }
+        if (n > 0 && msg[0] == 'D') {
+            printf("✓ Echoed %d UD messages\n", echoed);
+            printf("✓ Client finished\n");
+        }
+        
+        // Keep acknowledging (a lost final ack means retransmits) until the
+        // client closes the TCP connection
+        struct pollfd pfd = { .fd = ctx.sock, .events = POLLIN };
+        while (ud_progress(&ud) == 0 && poll(&pfd, 1, 1) == 0)
+            ;
+    } else if (read(ctx.sock, &sync_byte, 1) == 1) {
         printf("✓ Client finished\n");
     }
     
@@ -189,6 +473,21 @@ int main(int argc, char *argv[]) {
     } else {
         printf("✅ RDMA using regular memory\n");
         printf("   - Host buffer: %p\n", ctx.buffer);
+        if (ctx.odp_mode) print_odp_stats(&ctx);
+    }
+    if (rails.num_rails) {
+        printf("   - Rails: %d\n", rails.num_rails);
+        multirail_print(&rails);
+    }
+    print_xfer_stats("Bulk write received", &bulk);
+    print_xfer_stats("Reads served", &pull);
+    printf("   - Outstanding RDMA Reads: %d as initiator, %d as responder\n",
+           ctx.max_rd_atomic, ctx.max_dest_rd_atomic);
+    if (use_ud) ud_print_stats(&ud);
+    if (num_extra) {
+        printf("   - Primary accelerator %s on NIC %s\n",
+               ctx.gaudi_bus_id[0] ? ctx.gaudi_bus_id : "(none)", ctx.ib_dev_name);
+        print_accelerators(accels, num_extra);
     }
     printf("\n📊 Operations Summary:\n");
     printf("   ✓ Send/Receive: 3 iterations completed\n");
@@ -197,6 +496,10 @@ int main(int argc, char *argv[]) {
     printf("   with device memory due to DMA initiator requirements.\n");
     printf("   Use RDMA Write to push data or Send/Receive for bidirectional.\n");
     
+    ud_destroy(&ud);
+    multirail_cleanup(&rails);
+    close_accelerators(accels, num_extra);
+    mw_free(&session);
     cleanup_resources(&ctx);
     printf("\nServer shutdown complete\n");
     return 0;
@@ -0,0 +1,143 @@
+#include "rdma_startup.h"
+#include "rdma_topology.h"
+#include <pthread.h>
+
+#define CONNECT_RETRY_US 10000
+#define CONNECT_RETRIES 1000  // Give the server ~10s to start listening
+
+typedef struct {
+    rdma_context_t *ctx;
+    rdma_startup_t *st;
+    int listen_fd;
+    int sock;
+    int device_result;
+    volatile int abort;
+} startup_job_t;
+
+// Accelerator open, HBM allocation and DMA-buf export
+static void *device_thread(void *arg) {
+    startup_job_t *job = arg;
+    double start = now_ms();
+    
+    job->device_result = init_gaudi_dmabuf(job->ctx, job->st->buffer_size);
+    job->st->t_device = now_ms() - start;
+    return NULL;
+}
+
+// TCP accept (server) or connect with retries (client)
+static void *socket_thread(void *arg) {
+    startup_job_t *job = arg;
+    double start = now_ms();
+    int fd = -1;
+    
+    if (job->listen_fd >= 0) {
+        fd = accept(job->listen_fd, NULL, NULL);
+    } else {
+        for (int i = 0; i < CONNECT_RETRIES && !job->abort; i++) {
+            fd = sock_connect(job->st->server_name, job->st->port);
+            if (fd >= 0) break;
+            usleep(CONNECT_RETRY_US);
+        }
+    }
+    
+    job->sock = fd;
+    job->st->t_socket = now_ms() - start;
+    return NULL;
+}
+
+int parallel_startup(rdma_context_t *ctx, rdma_startup_t *st) {
+    startup_job_t job = { .ctx = ctx, .st = st, .listen_fd = -1, .sock = -1 };
+    pthread_t dev_tid, sock_tid;
+    int dev_threaded, sock_threaded;
+    const char *ib_dev = st->ib_dev_name;
+    char paired_nic[64];
+    double t0 = now_ms(), start;
+    int ok;
+    
+    // The NIC is opened before the accelerator is, so pair it from the bus
+    // ID up front, taking the first accelerator in sysfs if none was given
+    if (!ib_dev && !ctx->gaudi_bus_id[0]) {
+        char bus_ids[1][16];
+        if (topo_list_accelerators(bus_ids, 1) == 1) {
+            snprintf(ctx->gaudi_bus_id, sizeof(ctx->gaudi_bus_id), "%s", bus_ids[0]);
+        }
+    }
+    if (!ib_dev && ctx->gaudi_bus_id[0] &&
+        topo_pick_nic(ctx->gaudi_bus_id, paired_nic, sizeof(paired_nic)) == 0) {
+        printf("Accelerator %s paired with NIC %s\n", ctx->gaudi_bus_id, paired_nic);
+        ib_dev = paired_nic;
+    }
+    
+    if (!st->server_name) {
+        job.listen_fd = sock_listen(st->port);
+        if (job.listen_fd < 0) {
+            fprintf(stderr, "Failed to listen on port %d\n", st->port);
+            return -1;
+        }
+    }
+    
+    // Phase 1: accelerator || IB objects || TCP connection
+    sock_threaded = pthread_create(&sock_tid, NULL, socket_thread, &job) == 0;
+    dev_threaded = pthread_create(&dev_tid, NULL, device_thread, &job) == 0;
+    if (!dev_threaded) device_thread(&job);
+    
+    start = now_ms();
+    ok = open_rdma_device(ctx, ib_dev) == 0;
+    st->t_ib_open = now_ms() - start;
+    
+    if (dev_threaded) pthread_join(dev_tid, NULL);
+    ok = ok && job.device_result == 0;
+    
+    // Phase 2: MR registration, while the TCP accept may still be pending
+    if (ok) {
+        start = now_ms();
+        ok = register_rdma_memory(ctx) == 0;
+        st->t_register = now_ms() - start;
+    }
+    
+    if (!ok) {
+        // Unblock a pending accept/connect before bailing out
+        job.abort = 1;
+        if (job.listen_fd >= 0) shutdown(job.listen_fd, SHUT_RDWR);
+    }
+    if (sock_threaded) {
+        pthread_join(sock_tid, NULL);
+    } else if (ok) {
+        socket_thread(&job);
+    }
+    if (job.listen_fd >= 0) close(job.listen_fd);
+    
+    if (!ok) {
+        if (job.sock >= 0) close(job.sock);
+        return -1;
+    }
+    if (job.sock < 0) {
+        fprintf(stderr, "Failed to establish TCP connection\n");
+        return -1;
+    }
+    ctx->sock = job.sock;
+    
+    // Phase 3: exchange QP info over the established socket
+    start = now_ms();
+    if (connect_qp(ctx, st->server_name, st->port) < 0) {
+        return -1;
+    }
+    st->t_handshake = now_ms() - start;
+    st->t_total = now_ms() - t0;
+    return 0;
+}
+
+void print_startup_timing(const rdma_startup_t *st) {
+    double serial = st->t_device + st->t_ib_open + st->t_register +
+                    st->t_socket + st->t_handshake;
+    
+    printf("Startup timing:\n");
+    printf("   Accelerator setup:    %9.3f ms\n", st->t_device);
+    printf("   IB open/PD/CQ/QP:     %9.3f ms\n", st->t_ib_open);
+    printf("   MR registration:      %9.3f ms\n", st->t_register);
+    printf("   TCP connect/accept:   %9.3f ms\n", st->t_socket);
+    printf("   QP handshake:         %9.3f ms\n", st->t_handshake);
+    printf("   Sum of phases:        %9.3f ms\n", serial);
+    printf("   Time to first byte:   %9.3f ms (%.3f ms overlapped)\n",
+           st->t_total, serial - st->t_total);
+}
@@ -0,0 +1,95 @@
+#include "rdma_common.h"
+#include "rdma_filestream.h"
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-p port] [-d ib_dev] [-s buffer_size] [-c chunk_size] send <server> <file>\n", prog);
+    printf("       %s [-p port] [-d ib_dev] [-s buffer_size] recv <file>\n", prog);
+}
+
+// Stream a file (e.g. a checkpoint) to a peer's disk over RDMA
+int main(int argc, char *argv[]) {
+    rdma_context_t ctx = {0};
+    ctx.gaudi_fd = -1;
+    ctx.dmabuf_fd = -1;
+    ctx.sock = -1;
+    
+    int port = 20000;
+    char *ib_dev_name = NULL;
+    size_t buffer_size = (size_t)FSTREAM_MAX_SLOTS * FSTREAM_CHUNK_SIZE;
+    fstream_t fs = {0};
+    char *args[3];
+    int nargs = 0;
+    
+    // Parse arguments
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            ib_dev_name = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            buffer_size = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            fs.chunk = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-h") == 0) {
+            usage(argv[0]);
+            return 0;
+        } else if (nargs < 3) {
+            args[nargs++] = argv[i];
+        }
+    }
+    
+    int sending = nargs == 3 && strcmp(args[0], "send") == 0;
+    if (!sending && !(nargs == 2 && strcmp(args[0], "recv") == 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *path = args[nargs - 1];
+    
+    printf("RDMA File Stream (%s)\n", sending ? "sender" : "receiver");
+    printf("=========================\n");
+    printf("File: %s\n", path);
+    printf("Buffer size: %zu bytes\n", buffer_size);
+    if (ib_dev_name) printf("IB device: %s\n", ib_dev_name);
+    printf("\n");
+    
+    // File I/O lands in host memory
+    if (init_host_buffer(&ctx, buffer_size) < 0 ||
+        init_rdma_resources(&ctx, ib_dev_name) < 0) {
+        fprintf(stderr, "Failed to initialize RDMA resources\n");
+        cleanup_resources(&ctx);
+        return 1;
+    }
+    printf("✓ RDMA resources initialized on %s\n", ctx.ib_dev_name);
+    
+    if (sending) {
+        // The receiver may not be listening yet
+        int tries = 0;
+        while ((ctx.sock = sock_connect(args[1], port)) < 0 && ++tries < 500) {
+            usleep(10000);
+        }
+    } else {
+        int listen_fd = sock_listen(port);
+        printf("Waiting for sender on port %d...\n", port);
+        if (listen_fd >= 0) {
+            ctx.sock = accept(listen_fd, NULL, NULL);
+            close(listen_fd);
+        }
+    }
+    if (ctx.sock < 0 || connect_qp(&ctx, NULL, 0) < 0) {
+        fprintf(stderr, "Failed to establish connection\n");
+        cleanup_resources(&ctx);
+        return 1;
+    }
+    printf("✓ Connected\n");
+    
+    int ret = sending ? fstream_send(&ctx, path, &fs) : fstream_recv(&ctx, path, &fs);
+    if (ret < 0) {
+        fprintf(stderr, "File stream failed\n");
+    } else {
+        printf("\n=== Summary ===\n");
+        print_fstream_stats(sending ? "Sent" : "Received", &fs);
+    }
+    
+    cleanup_resources(&ctx);
+    return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,279 @@
+#include "rdma_topology.h"
+#include "rdma_transfer.h"
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+
+// Read a single integer from a sysfs attribute
+static long read_sysfs_long(const char *path, int base) {
+    char buf[32];
+    long val = -1;
+    FILE *f = fopen(path, "r");
+    
+    if (!f) return -1;
+    if (fgets(buf, sizeof(buf), f)) val = strtol(buf, NULL, base);
+    fclose(f);
+    return val;
+}
+
+// Number of leading path components two sysfs device paths share. Devices
+// under the same root complex share "/sys/devices/pciDDDD:BB" (3); every
+// extra shared component is a bridge or switch port above both of them.
+static int common_depth(const char *a, const char *b) {
+    int depth = 0;
+    
+    while (*a && *b) {
+        size_t la = strcspn(a, "/"), lb = strcspn(b, "/");
+        if (la != lb || strncmp(a, b, la)) break;
+        if (la) depth++;
+        a += la;
+        b += lb;
+        while (*a == '/') a++;
+        while (*b == '/') b++;
+    }
+    return depth;
+}
+
+int topo_list_accelerators(char bus_ids[][16], int max) {
+    const char *classes[] = { "/sys/class/accel", "/sys/class/habanalabs" };
+    int count = 0;
+    
+    for (int c = 0; c < 2; c++) {
+        DIR *dir = opendir(classes[c]);
+        struct dirent *de;
+        
+        if (!dir) continue;
+        while ((de = readdir(dir)) && count < max) {
+            char path[PATH_MAX], real[PATH_MAX];
+            int dup = 0;
+            
+            if (de->d_name[0] == '.') continue;
+            
+            snprintf(path, sizeof(path), "%s/%s/device/vendor", classes[c], de->d_name);
+            if (read_sysfs_long(path, 16) != HABANA_PCI_VENDOR) continue;
+            
+            snprintf(path, sizeof(path), "%s/%s/device", classes[c], de->d_name);
+            if (!realpath(path, real)) continue;
+            
+            const char *bus = strrchr(real, '/') + 1;
+            for (int i = 0; i < count; i++) {
+                if (strcmp(bus_ids[i], bus) == 0) dup = 1;
+            }
+            if (dup) continue;
+            
+            snprintf(bus_ids[count++], 16, "%s", bus);
+        }
+        closedir(dir);
+    }
+    
+    return count;
+}
+
+int parse_accel_list(const char *spec, char bus_ids[][16], int max) {
+    char *copy, *saveptr = NULL;
+    int count = 0;
+    
+    if (strcmp(spec, "all") == 0) {
+        return topo_list_accelerators(bus_ids, max);
+    }
+    
+    copy = strdup(spec);
+    if (!copy) return -1;
+    for (char *tok = strtok_r(copy, ",", &saveptr); tok && count < max;
+         tok = strtok_r(NULL, ",", &saveptr)) {
+        char path[PATH_MAX];
+        
+        // A mistyped ID must not quietly turn into a host-memory stand-in
+        snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/vendor", tok);
+        if (read_sysfs_long(path, 16) != HABANA_PCI_VENDOR) {
+            fprintf(stderr, "No accelerator at PCI bus ID %s\n", tok);
+            free(copy);
+            return -1;
+        }
+        snprintf(bus_ids[count++], 16, "%s", tok);
+    }
+    free(copy);
+    return count;
+}
+
+int topo_pick_nic(const char *bus_id, char *ib_dev, size_t len) {
+    char path[PATH_MAX + 32], accel_path[PATH_MAX];
+    long accel_numa, best_numa = -1;
+    int best_score = -1, best_remote = 0;
+    DIR *dir;
+    struct dirent *de;
+    
+    snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s", bus_id);
+    if (!realpath(path, accel_path)) return -1;
+    
+    snprintf(path, sizeof(path), "%s/numa_node", accel_path);
+    accel_numa = read_sysfs_long(path, 10);
+    
+    dir = opendir("/sys/class/infiniband");
+    if (!dir) return -1;
+    
+    while ((de = readdir(dir))) {
+        char nic_path[PATH_MAX];
+        int score;
+        
+        if (de->d_name[0] == '.') continue;
+        
+        snprintf(path, sizeof(path), "/sys/class/infiniband/%s/device", de->d_name);
+        if (!realpath(path, nic_path)) continue;
+        
+        snprintf(path, sizeof(path), "%s/numa_node", nic_path);
+        long nic_numa = read_sysfs_long(path, 10);
+        
+        // A NIC on another socket is only taken if there is no local one;
+        // among the rest, sharing a switch dominates and NUMA breaks ties
+        int remote = accel_numa >= 0 && nic_numa >= 0 && nic_numa != accel_numa;
+        score = common_depth(accel_path, nic_path) * 2;
+        if (accel_numa >= 0 && nic_numa == accel_numa) score++;
+        
+        if (best_score < 0 || remote < best_remote ||
+            (remote == best_remote && score > best_score)) {
+            best_score = score;
+            best_remote = remote;
+            best_numa = nic_numa;
+            snprintf(ib_dev, len, "%s", de->d_name);
+        }
+    }
+    closedir(dir);
+    
+    if (best_score < 0) return -1;
+    if (best_remote) {
+        fprintf(stderr, "Warning: no NIC on NUMA node %ld; accelerator %s paired with %s "
+                "on node %ld, P2P traffic will cross sockets\n",
+                accel_numa, bus_id, ib_dev, best_numa);
+    }
+    return 0;
+}
+
+int open_accelerator(rdma_context_t *ctx, const char *bus_id, size_t size,
+                     const char *ib_dev_override) {
+    char nic[64];
+    const char *ib_dev = ib_dev_override;
+    
+    snprintf(ctx->gaudi_bus_id, sizeof(ctx->gaudi_bus_id), "%s", bus_id ? bus_id : "");
+    if (init_gaudi_dmabuf(ctx, size) < 0) {
+        fprintf(stderr, "Failed to initialize accelerator %s\n", bus_id ? bus_id : "(any)");
+        return -1;
+    }
+    
+    if (!ib_dev && ctx->gaudi_bus_id[0] && topo_pick_nic(ctx->gaudi_bus_id, nic, sizeof(nic)) == 0) {
+        printf("Accelerator %s paired with NIC %s\n", ctx->gaudi_bus_id, nic);
+        ib_dev = nic;
+    }
+    
+    return init_rdma_resources(ctx, ib_dev);
+}
+
+int open_accelerators(rdma_context_t *ctxs, char bus_ids[][16], int n,
+                      size_t size, int odp_mode) {
+    for (int i = 0; i < n; i++) {
+        rdma_context_t *ctx = &ctxs[i];
+        
+        memset(ctx, 0, sizeof(*ctx));
+        ctx->gaudi_fd = -1;
+        ctx->dmabuf_fd = -1;
+        ctx->sock = -1;
+        ctx->odp_mode = odp_mode;
+        
+        if (open_accelerator(ctx, bus_ids[i], size, NULL) < 0) {
+            close_accelerators(ctxs, i + 1);
+            return -1;
+        }
+    }
+    return n;
+}
+
+int accel_connect(rdma_context_t *ctxs, int *n, rdma_context_t *primary,
+                  const char *server_name, int port) {
+    uint32_t local_n = htonl(*n), remote_n;
+    
+    // Pair up as many accelerators as the smaller side has
+    if (write(primary->sock, &local_n, sizeof(local_n)) != sizeof(local_n) ||
+        read(primary->sock, &remote_n, sizeof(remote_n)) != sizeof(remote_n)) {
+        fprintf(stderr, "Failed to exchange accelerator count\n");
+        return -1;
+    }
+    remote_n = ntohl(remote_n);
+    while (*n > (int)remote_n) {
+        cleanup_resources(&ctxs[--*n]);
+    }
+    
+    for (int i = 0; i < *n; i++) {
+        int tries = 0;
+        
+        // Ports after the rails' range; the client may beat the listen()
+        while (connect_qp(&ctxs[i], server_name, ACCEL_PORT(port, i)) < 0) {
+            if (!server_name || ctxs[i].sock >= 0 || ++tries >= 500) {
+                fprintf(stderr, "Failed to connect accelerator %s\n", ctxs[i].gaudi_bus_id);
+                return -1;
+            }
+            usleep(10000);
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    rdma_context_t *ctx;
+    rdma_xfer_t xfer;
+    int serve;
+    int result;
+} accel_job_t;
+
+static void *accel_thread(void *arg) {
+    accel_job_t *job = arg;
+    
+    job->result = job->serve ? xfer_serve(job->ctx, &job->xfer)
+                             : xfer_write(job->ctx, &job->xfer);
+    return NULL;
+}
+
+int accel_transfer(rdma_context_t *ctxs, int n, int serve, uint64_t *bytes) {
+    accel_job_t jobs[RDMA_MAX_ACCELS];
+    pthread_t tids[RDMA_MAX_ACCELS];
+    int threaded[RDMA_MAX_ACCELS];
+    int result = 0;
+    
+    // One thread per pair: each has its own QP, CQ and socket
+    for (int i = 0; i < n; i++) {
+        jobs[i] = (accel_job_t){ .ctx = &ctxs[i], .serve = serve,
+                                 .xfer = { .len = ctxs[i].buffer_size } };
+        threaded[i] = pthread_create(&tids[i], NULL, accel_thread, &jobs[i]) == 0;
+        if (!threaded[i]) accel_thread(&jobs[i]);
+    }
+    
+    *bytes = 0;
+    for (int i = 0; i < n; i++) {
+        if (threaded[i]) pthread_join(tids[i], NULL);
+        if (jobs[i].result < 0) {
+            fprintf(stderr, "Accelerator %s: transfer failed\n", ctxs[i].gaudi_bus_id);
+            result = -1;
+        }
+        *bytes += jobs[i].xfer.acked;
+    }
+    return result;
+}
+
+void close_accelerators(rdma_context_t *ctxs, int n) {
+    for (int i = 0; i < n; i++) {
+        cleanup_resources(&ctxs[i]);
+    }
+}
+
+void print_accelerators(rdma_context_t *ctxs, int n) {
+    for (int i = 0; i < n; i++) {
+        rdma_context_t *ctx = &ctxs[i];
+        if (ctx->dmabuf_fd >= 0) {
+            printf("   - Accelerator %s: DMA-buf fd %d, va 0x%lx, NIC %s\n",
+                   ctx->gaudi_bus_id, ctx->dmabuf_fd, ctx->device_va, ctx->ib_dev_name);
+        } else {
+            printf("   - Accelerator %s: host stand-in %p, NIC %s\n",
+                   ctx->gaudi_bus_id[0] ? ctx->gaudi_bus_id : "(none)",
+                   ctx->buffer, ctx->ib_dev_name);
+        }
+    }
+}
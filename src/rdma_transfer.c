@@ -0,0 +1,330 @@
+#include "rdma_transfer.h"
+#include <poll.h>
+
+// Receiver side of a checksummed write: one receive is posted per expected
+// chunk, up to depth ahead of the verified prefix. The sender posts chunk
+// k + window as soon as chunk k is acknowledged, which can be before we have
+// seen k's completion, so depth is twice its window; a receive that isn't
+// there yet costs an RNR NAK and a 0.64 ms back-off.
+typedef struct {
+    uint64_t chunk;
+    uint64_t chunks;
+    uint64_t posted;       // Receives posted up to this chunk index
+    int depth;
+    int hold;              // QP is about to be reset: don't repost
+} csum_rx_t;
+
+// Drive both QPs back to RTS and resume from the acknowledged prefix
+static int recover(rdma_context_t *ctx, rdma_xfer_t *x) {
+    double start = now_ms();
+    
+    if (x->recoveries >= XFER_MAX_RECOVERIES) {
+        fprintf(stderr, "Giving up after %d recoveries\n", x->recoveries);
+        return -1;
+    }
+    
+    printf("QP error, recovering (resuming at byte %lu)...\n", x->acked);
+    if (send_ctrl(ctx, CTRL_RECOVER, x->acked) || reconnect_qp(ctx)) {
+        fprintf(stderr, "QP recovery failed\n");
+        return -1;
+    }
+    
+    x->recoveries++;
+    x->recovery_ms += now_ms() - start;
+    printf("✓ QP recovered in %.3f ms\n", now_ms() - start);
+    return 0;
+}
+
+// Ask the peer to verify per-chunk checksums; it needs the geometry to post
+// a receive for every Write with immediate
+static int checksum_handshake(rdma_context_t *ctx, rdma_xfer_t *x, size_t chunk, int window) {
+    uint32_t type;
+    uint64_t value;
+    
+    if (!ctx->buffer) {
+        printf("Checksums need a CPU-visible buffer, sending unchecked\n");
+        x->checksum = 0;
+        return 0;
+    }
+    
+    if (send_ctrl(ctx, CTRL_CHECKSUM, x->len) ||
+        send_ctrl(ctx, CTRL_CHUNK, (uint64_t)chunk << 32 | window) ||
+        recv_ctrl(ctx, &type, &value) || type != CTRL_CHECKSUM) {
+        fprintf(stderr, "Failed to negotiate checksums\n");
+        return -1;
+    }
+    if (!value) {
+        printf("Peer can't verify checksums, sending unchecked\n");
+        x->checksum = 0;
+    }
+    return 0;
+}
+
+// Post the range in chunks with up to window outstanding, recovering on errors
+static int xfer_run(rdma_context_t *ctx, rdma_xfer_t *x, int opcode,
+                    size_t chunk, int window) {
+    struct ibv_wc wc[XFER_WINDOW];
+    uint64_t posted = x->acked;
+    int outstanding = 0;
+    double start = now_ms();
+    
+    if (x->checksum && checksum_handshake(ctx, x, chunk, window)) return -1;
+    
+    while (x->acked < x->len) {
+        int failed = 0;
+        
+        while (outstanding < window && posted < x->len) {
+            uint32_t n = x->len - posted < chunk ? x->len - posted : chunk;
+            int ret;
+            
+            if (x->checksum) {
+                double t = now_ms();
+                uint32_t crc = crc32c(0, (char *)ctx->buffer + x->local_off + posted, n);
+                x->crc_ms += now_ms() - t;
+                x->crc_chunks++;
+                ret = post_write_imm(ctx, x->local_off + posted, x->remote_off + posted,
+                                     n, crc, n);
+            } else {
+                ret = post_rdma_range(ctx, opcode, x->local_off + posted,
+                                      x->remote_off + posted, n, n);
+            }
+            if (ret) {
+                failed = 1;
+                break;
+            }
+            posted += n;
+            outstanding++;
+        }
+        
+        if (!failed) {
+            int ne = ibv_poll_cq(ctx->cq, window, wc);
+            if (ne < 0) {
+                fprintf(stderr, "Poll CQ failed\n");
+                return -1;
+            }
+            // RC completions arrive in posting order, so the acknowledged
+            // bytes always form a prefix of the range
+            for (int i = 0; i < ne; i++) {
+                if (wc[i].status != IBV_WC_SUCCESS) {
+                    fprintf(stderr, "Work completion error: %s\n",
+                            ibv_wc_status_str(wc[i].status));
+                    failed = 1;
+                    break;
+                }
+                x->acked += wc[i].wr_id;
+                outstanding--;
+            }
+        }
+        
+        if (failed) {
+            if (recover(ctx, x)) return -1;
+            posted = x->acked;
+            outstanding = 0;
+        }
+    }
+    
+    x->elapsed_ms = now_ms() - start;
+    
+    // Tell the peer we're done and wait for its acknowledgement
+    uint32_t type;
+    uint64_t value;
+    if (send_ctrl(ctx, CTRL_DONE, x->acked) || recv_ctrl(ctx, &type, &value) ||
+        type != CTRL_DONE) {
+        fprintf(stderr, "Failed to complete transfer handshake\n");
+        return -1;
+    }
+    if (x->checksum) x->crc_errors = value;
+    return 0;
+}
+
+static void process_range(rdma_context_t *ctx, rdma_xfer_t *x, uint64_t off, size_t len) {
+    double t = now_ms();
+    
+    x->process(ctx->buffer ? (char *)ctx->buffer + x->local_off + off : NULL, len,
+               x->process_arg);
+    x->process_ms += now_ms() - t;
+}
+
+static int sock_readable(int sock) {
+    struct pollfd pfd = { .fd = sock, .events = POLLIN };
+    return poll(&pfd, 1, 0) > 0;
+}
+
+static int post_chunk_receives(rdma_context_t *ctx, csum_rx_t *rx, uint64_t verified) {
+    uint64_t limit = verified / rx->chunk + rx->depth;
+    
+    if (rx->hold) return 0;
+    while (rx->posted < rx->chunks && rx->posted < limit) {
+        if (post_imm_receive(ctx)) {
+            fprintf(stderr, "Failed to post chunk receive\n");
+            return -1;
+        }
+        rx->posted++;
+    }
+    return 0;
+}
+
+// Check the CRC32C carried in the immediate of every chunk that landed and
+// hand it to x->process. Writes complete in order, so each one extends the
+// verified prefix. Returns the number of completions handled.
+static int verify_chunks(rdma_context_t *ctx, rdma_xfer_t *x, csum_rx_t *rx) {
+    struct ibv_wc wc[XFER_WINDOW];
+    uint64_t landed = x->acked;
+    int ne = ibv_poll_cq(ctx->cq, XFER_WINDOW, wc);
+    
+    if (ne < 0) {
+        fprintf(stderr, "Poll CQ failed\n");
+        return -1;
+    }
+    
+    // Replace the consumed receives before spending time on the CRCs
+    for (int i = 0; i < ne; i++) {
+        if (wc[i].status == IBV_WC_SUCCESS && wc[i].opcode == IBV_WC_RECV_RDMA_WITH_IMM) {
+            landed += wc[i].byte_len;
+        }
+    }
+    if (ne && post_chunk_receives(ctx, rx, landed)) return -1;
+    
+    for (int i = 0; i < ne; i++) {
+        // Errors are left to the sender, which starts a recovery
+        if (wc[i].status != IBV_WC_SUCCESS || wc[i].opcode != IBV_WC_RECV_RDMA_WITH_IMM) {
+            continue;
+        }
+        
+        double t = now_ms();
+        uint32_t crc = crc32c(0, (char *)ctx->buffer + x->local_off + x->acked, wc[i].byte_len);
+        x->crc_ms += now_ms() - t;
+        x->crc_chunks++;
+        
+        if (crc != ntohl(wc[i].imm_data) && x->crc_errors++ < 8) {
+            fprintf(stderr, "Checksum mismatch in chunk at byte %lu: %08x, expected %08x\n",
+                    x->acked, crc, ntohl(wc[i].imm_data));
+        }
+        if (x->process) process_range(ctx, x, x->acked, wc[i].byte_len);
+        x->acked += wc[i].byte_len;
+    }
+    return ne;
+}
+
+// Set up verification of a checksummed write of len bytes; tells the peer
+// whether we can verify
+static int accept_checksums(rdma_context_t *ctx, rdma_xfer_t *x, csum_rx_t *rx, uint64_t len) {
+    uint32_t type;
+    uint64_t value;
+    
+    if (recv_ctrl(ctx, &type, &value) || type != CTRL_CHUNK) {
+        fprintf(stderr, "Expected the checksummed write geometry\n");
+        return -1;
+    }
+    rx->chunk = value >> 32;
+    rx->depth = 2 * (value & 0xffffffff);
+    if (rx->depth > RDMA_MAX_WR) rx->depth = RDMA_MAX_WR;
+    rx->chunks = rx->chunk ? (len + rx->chunk - 1) / rx->chunk : 0;
+    rx->posted = 0;
+    
+    x->checksum = ctx->buffer && rx->chunk && x->local_off + len <= ctx->buffer_size;
+    x->acked = 0;
+    if (x->checksum && post_chunk_receives(ctx, rx, 0)) return -1;
+    return send_ctrl(ctx, CTRL_CHECKSUM, x->checksum);
+}
+
+int xfer_serve(rdma_context_t *ctx, rdma_xfer_t *x) {
+    csum_rx_t rx = {0};
+    uint64_t total = 0;
+    int done = 0;
+    
+    // With checksums the peer's completion can overtake the last chunks'
+    // receive completions, so keep verifying until all of them are in
+    while (!done || (x->checksum && x->acked < total)) {
+        uint32_t type;
+        uint64_t value;
+        
+        if (x->checksum) {
+            if (verify_chunks(ctx, x, &rx) < 0) return -1;
+            if (done || !sock_readable(ctx->sock)) continue;
+        }
+        
+        if (recv_ctrl(ctx, &type, &value)) {
+            fprintf(stderr, "Control channel closed\n");
+            return -1;
+        }
+        
+        if (type == CTRL_DONE) {
+            total = value;
+            done = 1;
+        } else if (type == CTRL_CHECKSUM) {
+            if (accept_checksums(ctx, x, &rx, value)) return -1;
+        } else if (type == CTRL_RECOVER) {
+            double t = now_ms();
+            int ne = 0;
+            
+            // Chunks that landed before the error still have completions
+            // queued, which the reset would discard unverified
+            rx.hold = 1;
+            while (x->checksum && (ne = verify_chunks(ctx, x, &rx)) > 0)
+                ;
+            rx.hold = 0;
+            if (ne < 0) return -1;
+            
+            printf("Peer QP error, recovering (peer resumes at byte %lu)...\n", value);
+            if (reconnect_qp(ctx)) {
+                fprintf(stderr, "QP recovery failed\n");
+                return -1;
+            }
+            
+            // The reset dropped our receives; chunks past the peer's
+            // acknowledged prefix come again and are verified again
+            if (x->checksum) {
+                x->acked = value;
+                rx.posted = value / rx.chunk;
+                if (post_chunk_receives(ctx, &rx, value)) return -1;
+            }
+            
+            x->recoveries++;
+            x->recovery_ms += now_ms() - t;
+            printf("✓ QP recovered in %.3f ms\n", now_ms() - t);
+        }
+    }
+    
+    // The reply carries our count of bad chunks when verifying
+    if (!x->checksum) {
+        x->acked = total;
+        if (x->process && total) process_range(ctx, x, 0, total);
+    }
+    return send_ctrl(ctx, CTRL_DONE, x->checksum ? x->crc_errors : total);
+}
+
+int xfer_write(rdma_context_t *ctx, rdma_xfer_t *x) {
+    return xfer_run(ctx, x, IBV_WR_RDMA_WRITE,
+                    x->chunk ? x->chunk : XFER_CHUNK_SIZE, XFER_WINDOW);
+}
+
+int xfer_read(rdma_context_t *ctx, rdma_xfer_t *x) {
+    // The NIC only has max_rd_atomic reads on the wire; keep the same number
+    // queued behind them so a completion never leaves the pipe empty
+    int window = 2 * (ctx->max_rd_atomic ? ctx->max_rd_atomic : 1);
+    if (window > XFER_WINDOW) window = XFER_WINDOW;
+    
+    // Reads carry no immediate to put a checksum in
+    x->checksum = 0;
+    return xfer_run(ctx, x, IBV_WR_RDMA_READ,
+                    x->chunk ? x->chunk : XFER_READ_CHUNK_SIZE, window);
+}
+
+void print_xfer_stats(const char *label, const rdma_xfer_t *x) {
+    printf("   - %s: %lu bytes", label, x->acked);
+    if (x->elapsed_ms > 0) {
+        printf(" in %.3f ms (%.2f GB/s)", x->elapsed_ms, x->acked / (x->elapsed_ms * 1e6));
+    }
+    printf("\n");
+    if (x->recoveries) {
+        printf("     %d QP recover%s, %.3f ms total\n", x->recoveries,
+               x->recoveries == 1 ? "y" : "ies", x->recovery_ms);
+    }
+    if (x->checksum) {
+        printf("     CRC32C (%s): %lu chunk(s), %lu bad, %.3f ms CPU", crc32c_impl(),
+               x->crc_chunks, x->crc_errors, x->crc_ms);
+        if (x->crc_ms > 0) printf(" (%.2f GB/s)", x->acked / (x->crc_ms * 1e6));
+        printf("\n");
+    }
+}
@@ -0,0 +1,423 @@
+#include "rdma_ud.h"
+
+#define UD_HDR_SIZE sizeof(struct ud_hdr_t)
+#define UD_RECV_SLOT (UD_GRH_SIZE + UD_HDR_SIZE + UD_MSG_SIZE)
+#define UD_SEND_SLOT (UD_HDR_SIZE + UD_MSG_SIZE)
+#define UD_SEND_WRID (1ULL << 63)
+
+#define UD_RECV_AREA ((size_t)UD_RECV_DEPTH * UD_RECV_SLOT)
+#define UD_SEND_AREA ((size_t)UD_MAX_PEERS * UD_WINDOW * UD_SEND_SLOT)
+#define UD_ACK_AREA ((size_t)UD_MAX_PEERS * UD_HDR_SIZE)
+
+// Everything a peer needs to address our UD QP, network byte order
+struct ud_addr_t {
+    uint32_t qpn;
+    uint32_t idx;   // Index the peer must stamp on messages to us
+    uint16_t lid;
+    uint8_t gid[16];
+} __attribute__((packed));
+
+static char *recv_slot(ud_endpoint_t *ud, int i) {
+    return ud->buf + (size_t)i * UD_RECV_SLOT;
+}
+
+static char *send_slot(ud_endpoint_t *ud, int peer, uint32_t seq) {
+    return ud->buf + UD_RECV_AREA +
+           ((size_t)peer * UD_WINDOW + seq % UD_WINDOW) * UD_SEND_SLOT;
+}
+
+static char *ack_slot(ud_endpoint_t *ud, int peer) {
+    return ud->buf + UD_RECV_AREA + UD_SEND_AREA + (size_t)peer * UD_HDR_SIZE;
+}
+
+static int post_ud_recv(ud_endpoint_t *ud, int i) {
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)recv_slot(ud, i),
+        .length = UD_RECV_SLOT,
+        .lkey = ud->mr->lkey
+    };
+    struct ibv_recv_wr wr = { .wr_id = i, .sg_list = &sge, .num_sge = 1 }, *bad_wr;
+    
+    return ibv_post_recv(ud->qp, &wr, &bad_wr);
+}
+
+// Never drains the CQ itself, since it is reached from inside ud_progress();
+// returns -EAGAIN when the send queue is full
+static int post_ud_send(ud_endpoint_t *ud, int peer, char *slot, uint32_t len) {
+    ud_peer_t *p = &ud->peers[peer];
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)slot,
+        .length = len,
+        .lkey = ud->mr->lkey
+    };
+    struct ibv_send_wr wr = {
+        .wr_id = UD_SEND_WRID | peer,
+        .sg_list = &sge,
+        .num_sge = 1,
+        .opcode = IBV_WR_SEND,
+        .send_flags = IBV_SEND_SIGNALED,
+        .wr.ud = { .ah = p->ah, .remote_qpn = p->qpn, .remote_qkey = UD_QKEY }
+    }, *bad_wr;
+    
+    if (ud->send_outstanding >= UD_SEND_DEPTH) return -EAGAIN;
+    
+    if (ibv_post_send(ud->qp, &wr, &bad_wr)) {
+        fprintf(stderr, "Failed to post UD send\n");
+        return -1;
+    }
+    ud->send_outstanding++;
+    return 0;
+}
+
+static int send_ack(ud_endpoint_t *ud, int peer) {
+    struct ud_hdr_t *hdr = (struct ud_hdr_t *)ack_slot(ud, peer);
+    
+    // A newer cumulative ack may overwrite one still in flight; both are valid
+    hdr->seq = htonl(ud->peers[peer].expected);
+    hdr->src = htons(ud->peers[peer].remote_idx);
+    hdr->type = UD_ACK;
+    hdr->len = 0;
+    return post_ud_send(ud, peer, (char *)hdr, UD_HDR_SIZE);
+}
+
+static int transmit(ud_endpoint_t *ud, int peer, uint32_t seq) {
+    char *slot = send_slot(ud, peer, seq);
+    struct ud_hdr_t *hdr = (struct ud_hdr_t *)slot;
+    
+    return post_ud_send(ud, peer, slot, UD_HDR_SIZE + hdr->len);
+}
+
+// Acks go out from ud_progress() once the CQ is drained, one cumulative ack
+// per peer however many messages arrived
+static void handle_recv(ud_endpoint_t *ud, struct ibv_wc *wc) {
+    struct ud_hdr_t *hdr = (struct ud_hdr_t *)(recv_slot(ud, wc->wr_id) + UD_GRH_SIZE);
+    uint32_t seq;
+    int peer;
+    ud_peer_t *p;
+    
+    if (wc->byte_len < UD_GRH_SIZE + UD_HDR_SIZE) return;
+    peer = ntohs(hdr->src);
+    seq = ntohl(hdr->seq);
+    if (peer >= ud->num_peers) return;
+    p = &ud->peers[peer];
+    // The header's src is only trusted if the datagram came from that
+    // peer's QP; anything else with our qkey is stray or stale
+    if (wc->src_qp != p->qpn) return;
+    
+    if (hdr->type == UD_ACK) {
+        // Cumulative: only move forward, and never past what was sent
+        if ((int32_t)(seq - p->acked) > 0 && (int32_t)(p->next_seq - seq) >= 0) {
+            p->acked = seq;
+            p->retries = 0;
+            p->sent_ms = now_ms();
+        }
+        return;
+    }
+    
+    // In-order data is delivered if there is room; anything else is dropped
+    // and the ack tells the sender where to resume
+    if (seq == p->expected && ud->inbox_count < UD_INBOX && hdr->len <= UD_MSG_SIZE &&
+        wc->byte_len >= UD_GRH_SIZE + UD_HDR_SIZE + hdr->len) {
+        ud_inbox_t *m = &ud->inbox[(ud->inbox_head + ud->inbox_count) % UD_INBOX];
+        m->peer = peer;
+        m->len = hdr->len;
+        memcpy(m->data, (char *)hdr + UD_HDR_SIZE, hdr->len);
+        ud->inbox_count++;
+        ud->received++;
+        p->expected++;
+    } else if ((int32_t)(seq - p->expected) < 0) {
+        ud->duplicates++;
+    }
+    p->ack_pending = 1;
+}
+
+static int send_pending_acks(ud_endpoint_t *ud) {
+    for (int i = 0; i < ud->num_peers; i++) {
+        int ret;
+        
+        if (!ud->peers[i].ack_pending) continue;
+        ret = send_ack(ud, i);
+        if (ret == -EAGAIN) return 0;  // Next progress call
+        if (ret) return -1;
+        ud->peers[i].ack_pending = 0;
+    }
+    return 0;
+}
+
+// Go-back-N: on timeout resend everything from the oldest unacked message
+static int check_timers(ud_endpoint_t *ud) {
+    double now = now_ms();
+    
+    for (int i = 0; i < ud->num_peers; i++) {
+        ud_peer_t *p = &ud->peers[i];
+        
+        if (p->failed || p->acked == p->next_seq || now - p->sent_ms < UD_RTO_MS) continue;
+        
+        // Resend the window in one go, or wait for send queue room
+        if (ud->send_outstanding + (int)(p->next_seq - p->acked) > UD_SEND_DEPTH) continue;
+        
+        if (++p->retries > UD_MAX_RETRIES) {
+            fprintf(stderr, "UD peer %d unreachable after %d retransmissions\n",
+                    i, UD_MAX_RETRIES);
+            p->failed = 1;
+            continue;
+        }
+        for (uint32_t seq = p->acked; seq != p->next_seq; seq++) {
+            if (transmit(ud, i, seq)) return -1;
+            ud->retransmits++;
+        }
+        p->sent_ms = now;
+    }
+    return 0;
+}
+
+int ud_progress(ud_endpoint_t *ud) {
+    struct ibv_wc wc[16];
+    int ne;
+    
+    while ((ne = ibv_poll_cq(ud->cq, 16, wc)) > 0) {
+        for (int i = 0; i < ne; i++) {
+            if (wc[i].wr_id & UD_SEND_WRID) {
+                ud->send_outstanding--;
+                if (wc[i].status != IBV_WC_SUCCESS) {
+                    fprintf(stderr, "UD send failed: %s\n", ibv_wc_status_str(wc[i].status));
+                    return -1;
+                }
+                continue;
+            }
+            
+            if (wc[i].status != IBV_WC_SUCCESS) {
+                fprintf(stderr, "UD receive failed: %s\n", ibv_wc_status_str(wc[i].status));
+                return -1;
+            }
+            handle_recv(ud, &wc[i]);
+            if (post_ud_recv(ud, wc[i].wr_id)) {
+                fprintf(stderr, "Failed to repost UD receive\n");
+                return -1;
+            }
+        }
+    }
+    if (ne < 0) {
+        fprintf(stderr, "Poll UD CQ failed\n");
+        return -1;
+    }
+    
+    if (send_pending_acks(ud)) return -1;
+    return check_timers(ud);
+}
+
+int ud_init(ud_endpoint_t *ud, rdma_context_t *ctx) {
+    size_t size = UD_RECV_AREA + UD_SEND_AREA + UD_ACK_AREA;
+    
+    memset(ud, 0, sizeof(*ud));
+    ud->ctx = ctx;
+    
+    ud->buf = calloc(1, size);
+    if (!ud->buf) return -1;
+    
+    ud->mr = ibv_reg_mr(ctx->pd, ud->buf, size, IBV_ACCESS_LOCAL_WRITE);
+    if (!ud->mr) {
+        fprintf(stderr, "Failed to register UD buffer\n");
+        ud_destroy(ud);
+        return -1;
+    }
+    
+    ud->cq = ibv_create_cq(ctx->ib_ctx, UD_SEND_DEPTH + UD_RECV_DEPTH, NULL, NULL, 0);
+    if (!ud->cq) {
+        fprintf(stderr, "Failed to create UD CQ\n");
+        ud_destroy(ud);
+        return -1;
+    }
+    
+    struct ibv_qp_init_attr qp_init_attr = {
+        .send_cq = ud->cq,
+        .recv_cq = ud->cq,
+        .qp_type = IBV_QPT_UD,
+        .cap = {
+            .max_send_wr = UD_SEND_DEPTH,
+            .max_recv_wr = UD_RECV_DEPTH,
+            .max_send_sge = 1,
+            .max_recv_sge = 1
+        }
+    };
+    ud->qp = ibv_create_qp(ctx->pd, &qp_init_attr);
+    if (!ud->qp) {
+        fprintf(stderr, "Failed to create UD QP\n");
+        ud_destroy(ud);
+        return -1;
+    }
+    
+    // UD needs no remote information to reach RTS
+    struct ibv_qp_attr attr = {
+        .qp_state = IBV_QPS_INIT,
+        .pkey_index = 0,
+        .port_num = ctx->ib_port,
+        .qkey = UD_QKEY
+    };
+    if (ibv_modify_qp(ud->qp, &attr, IBV_QP_STATE | IBV_QP_PKEY_INDEX |
+                      IBV_QP_PORT | IBV_QP_QKEY)) {
+        fprintf(stderr, "Failed to modify UD QP to INIT\n");
+        ud_destroy(ud);
+        return -1;
+    }
+    
+    attr.qp_state = IBV_QPS_RTR;
+    if (ibv_modify_qp(ud->qp, &attr, IBV_QP_STATE)) {
+        fprintf(stderr, "Failed to modify UD QP to RTR\n");
+        ud_destroy(ud);
+        return -1;
+    }
+    
+    attr.qp_state = IBV_QPS_RTS;
+    attr.sq_psn = 0;
+    if (ibv_modify_qp(ud->qp, &attr, IBV_QP_STATE | IBV_QP_SQ_PSN)) {
+        fprintf(stderr, "Failed to modify UD QP to RTS\n");
+        ud_destroy(ud);
+        return -1;
+    }
+    
+    for (int i = 0; i < UD_RECV_DEPTH; i++) {
+        if (post_ud_recv(ud, i)) {
+            fprintf(stderr, "Failed to post UD receive\n");
+            ud_destroy(ud);
+            return -1;
+        }
+    }
+    
+    printf("UD endpoint: QPN 0x%06x\n", ud->qp->qp_num);
+    return 0;
+}
+
+int ud_connect(ud_endpoint_t *ud, int sock) {
+    rdma_context_t *ctx = ud->ctx;
+    struct ud_addr_t local = {0}, remote;
+    union ibv_gid gid;
+    int idx = ud->num_peers;
+    ud_peer_t *p = &ud->peers[idx];
+    size_t got = 0;
+    
+    if (idx >= UD_MAX_PEERS) {
+        fprintf(stderr, "Too many UD peers\n");
+        return -1;
+    }
+    
+    // The address is all a datagram peer needs; no RC state is involved
+    query_local_gid(ctx, &gid);
+    local.qpn = htonl(ud->qp->qp_num);
+    local.idx = htonl(idx);
+    local.lid = htons(ctx->port_attr.lid);
+    memcpy(local.gid, &gid, 16);
+    if (write(sock, &local, sizeof(local)) != sizeof(local)) {
+        fprintf(stderr, "Failed to exchange UD info\n");
+        return -1;
+    }
+    while (got < sizeof(remote)) {
+        ssize_t n = read(sock, (char *)&remote + got, sizeof(remote) - got);
+        if (n <= 0) {
+            fprintf(stderr, "Failed to exchange UD info\n");
+            return -1;
+        }
+        got += n;
+    }
+    
+    struct ibv_ah_attr ah_attr = {
+        .dlid = ntohs(remote.lid),
+        .sl = 0,
+        .port_num = ctx->ib_port
+    };
+    if (memcmp(remote.gid, "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0", 16)) {
+        ah_attr.is_global = 1;
+        memcpy(&ah_attr.grh.dgid, remote.gid, 16);
+        ah_attr.grh.sgid_index = ctx->gid_index;
+        ah_attr.grh.hop_limit = ctx->gid_is_rocev2 ? 64 : 1;
+        ah_attr.grh.traffic_class = ctx->traffic_class;
+    }
+    
+    memset(p, 0, sizeof(*p));
+    p->ah = ibv_create_ah(ctx->pd, &ah_attr);
+    if (!p->ah) {
+        fprintf(stderr, "Failed to create address handle\n");
+        return -1;
+    }
+    p->qpn = ntohl(remote.qpn);
+    p->remote_idx = ntohl(remote.idx);
+    ud->num_peers++;
+    
+    printf("UD peer %d: QPN 0x%06x\n", idx, p->qpn);
+    return idx;
+}
+
+int ud_send(ud_endpoint_t *ud, int peer, const void *data, size_t len) {
+    ud_peer_t *p;
+    struct ud_hdr_t *hdr;
+    int ret;
+    
+    if (peer < 0 || peer >= ud->num_peers || len > UD_MSG_SIZE) return -1;
+    p = &ud->peers[peer];
+    
+    while (!p->failed && p->next_seq - p->acked >= UD_WINDOW) {
+        if (ud_progress(ud) < 0) return -1;
+    }
+    if (p->failed) return -1;
+    
+    hdr = (struct ud_hdr_t *)send_slot(ud, peer, p->next_seq);
+    hdr->seq = htonl(p->next_seq);
+    hdr->src = htons(p->remote_idx);
+    hdr->type = UD_DATA;
+    hdr->len = len;
+    memcpy((char *)hdr + UD_HDR_SIZE, data, len);
+    
+    // Top level, so draining the CQ for send queue room is safe here
+    while ((ret = transmit(ud, peer, p->next_seq)) == -EAGAIN) {
+        if (ud_progress(ud) < 0) return -1;
+    }
+    if (ret) return -1;
+    if (p->acked == p->next_seq) p->sent_ms = now_ms();
+    p->next_seq++;
+    ud->sent++;
+    return 0;
+}
+
+int ud_recv(ud_endpoint_t *ud, int *peer, void *data, size_t max, int timeout_ms) {
+    double deadline = now_ms() + timeout_ms;
+    ud_inbox_t *m;
+    int len;
+    
+    while (ud->inbox_count == 0) {
+        if (ud_progress(ud) < 0 || now_ms() >= deadline) return -1;
+    }
+    
+    m = &ud->inbox[ud->inbox_head];
+    len = m->len < max ? m->len : max;
+    memcpy(data, m->data, len);
+    if (peer) *peer = m->peer;
+    ud->inbox_head = (ud->inbox_head + 1) % UD_INBOX;
+    ud->inbox_count--;
+    return len;
+}
+
+int ud_flush(ud_endpoint_t *ud, int peer, int timeout_ms) {
+    ud_peer_t *p = &ud->peers[peer];
+    double deadline = now_ms() + timeout_ms;
+    
+    while (p->acked != p->next_seq) {
+        if (p->failed || ud_progress(ud) < 0 || now_ms() >= deadline) return -1;
+    }
+    return 0;
+}
+
+void ud_print_stats(ud_endpoint_t *ud) {
+    printf("   - UD: %lu sent, %lu received, %lu retransmitted, %lu duplicates\n",
+           ud->sent, ud->received, ud->retransmits, ud->duplicates);
+}
+
+void ud_destroy(ud_endpoint_t *ud) {
+    for (int i = 0; i < ud->num_peers; i++) {
+        if (ud->peers[i].ah) ibv_destroy_ah(ud->peers[i].ah);
+    }
+    if (ud->qp) ibv_destroy_qp(ud->qp);
+    if (ud->cq) ibv_destroy_cq(ud->cq);
+    if (ud->mr) ibv_dereg_mr(ud->mr);
+    free(ud->buf);
+    memset(ud, 0, sizeof(*ud));
+}